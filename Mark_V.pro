@@ -6,6 +6,37 @@ CONFIG += qt warn_on cascades10
 QMAKE_LFLAGS += -fuse-ld=bfd
 QMAKE_CXXFLAGS += -std=c++1y
 
+# qmake CONFIG+=trace records hot path spans, see src/Trace.hpp
+trace {
+            DEFINES += MARKV_TRACE
+}
+
+# qmake CONFIG+=markv_profile times the core by subsystem, see src/Profile.hpp
+# (not "profile", which is Momentics' Profile build configuration)
+markv_profile {
+            DEFINES += MARKV_PROFILE
+            QMAKE_LFLAGS += -Wl,--wrap=m68k_run -Wl,--wrap=z80_run -Wl,--wrap=render_line \
+                            -Wl,--wrap=YM2612Update -Wl,--wrap=psg_end_frame \
+                            -Wl,--wrap=s68k_run -Wl,--wrap=cdd_update
+            SOURCES += $$quote($$_PRO_FILE_PWD_/src/ProfileHooks.cpp)
+}
+
+# qmake CONFIG+=cdda decodes OGG audio tracks ahead of the CDD, see src/CddaDecoder.hpp.
+# Needs a genlib built with USE_LIBTREMOR and its cdStream hooks pointed at DiscCache.
+cdda {
+            CONFIG += disccache
+            DEFINES += MARKV_CDDA
+            QMAKE_LFLAGS += -Wl,--wrap=ov_read -Wl,--wrap=ov_pcm_seek -Wl,--wrap=ov_pcm_tell -Wl,--wrap=ov_clear
+            SOURCES += $$quote($$_PRO_FILE_PWD_/src/CddaDecoderHooks.cpp)
+}
+
+# qmake CONFIG+=disccache reads Sega CD images ahead of the CDD, see src/DiscCache.hpp.
+# Needs a genlib whose osd.h points its cdStream hooks at DiscCache.
+disccache {
+            DEFINES += MARKV_DISCCACHE
+            SOURCES += $$quote($$_PRO_FILE_PWD_/src/DiscCacheHooks.cpp)
+}
+
 device {
             QMAKE_CC = qcc -V4.8.3,gcc_ntoarmv7le  
             QMAKE_CXX = qcc -V4.8.3,gcc_ntoarmv7le 
@@ -89,6 +89,7 @@ config_pri_assets {
         $$quote($$BASEDIR/assets/ic_info.png) \
         $$quote($$BASEDIR/assets/ic_load.png) \
         $$quote($$BASEDIR/assets/ic_noboxart.png) \
+        $$quote($$BASEDIR/assets/ic_record.png) \
         $$quote($$BASEDIR/assets/ic_rename.png) \
         $$quote($$BASEDIR/assets/ic_save.png) \
         $$quote($$BASEDIR/assets/ic_select_more.png) \
@@ -99,8 +100,30 @@ config_pri_source_group1 {
     SOURCES += $$quote($$BASEDIR/src/main.cpp)
 
     HEADERS += \
+        $$quote($$BASEDIR/src/AudioFilter.hpp) \
+        $$quote($$BASEDIR/src/AudioSink.hpp) \
+        $$quote($$BASEDIR/src/AudioStretch.hpp) \
+        $$quote($$BASEDIR/src/CddaDecoder.hpp) \
+        $$quote($$BASEDIR/src/ChunkStore.hpp) \
+        $$quote($$BASEDIR/src/CoverPreview.hpp) \
+        $$quote($$BASEDIR/src/DiscCache.hpp) \
+        $$quote($$BASEDIR/src/FramePacer.hpp) \
+        $$quote($$BASEDIR/src/FramePipeline.hpp) \
         $$quote($$BASEDIR/src/GameLibraryUI.hpp) \
-        $$quote($$BASEDIR/src/GenesisViewUI.hpp)
+        $$quote($$BASEDIR/src/GenesisViewUI.hpp) \
+        $$quote($$BASEDIR/src/HeadlessRunner.hpp) \
+        $$quote($$BASEDIR/src/ImportPipeline.hpp) \
+        $$quote($$BASEDIR/src/LibraryDataModel.hpp) \
+        $$quote($$BASEDIR/src/Profile.hpp) \
+        $$quote($$BASEDIR/src/RomPatcher.hpp) \
+        $$quote($$BASEDIR/src/ScreenshotWriter.hpp) \
+        $$quote($$BASEDIR/src/SessionRecorder.hpp) \
+        $$quote($$BASEDIR/src/Snapshot.hpp) \
+        $$quote($$BASEDIR/src/StateListModel.hpp) \
+        $$quote($$BASEDIR/src/TitleIndex.hpp) \
+        $$quote($$BASEDIR/src/Trace.hpp) \
+        $$quote($$BASEDIR/src/VideoPresenter.hpp) \
+        $$quote($$BASEDIR/src/ZipReader.hpp)
 }
 
 CONFIG += precompile_header
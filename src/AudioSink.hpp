@@ -0,0 +1,368 @@
+/*
+ * AudioSink.hpp
+ *
+ *  Created on: Oct 19, 2026
+ *      Author: swatson
+ */
+
+#pragma once
+
+#include <cerrno>
+#include <cstdio>
+#include <cstring>
+#include <cstdint>
+#include <unistd.h>
+
+#if defined(__QNX__)
+#include <sys/asoundlib.h>
+#endif
+
+
+#include <QFile>
+#include <QString>
+#include <QSettings>
+#include <QElapsedTimer>
+
+
+/*
+ * Where the emulator's interleaved stereo S16 samples go.
+ *
+ * A sink buffers frags fragments of frag_size bytes. Smaller and
+ * fewer fragments mean less latency and more risk of underruns;
+ * both are reported so the numbers can be tuned per device.
+ *
+ * Sinks are chosen and configured from QSettings:
+ *
+ *     audio/sink      "qsa" (QNX), "null" or "file"
+ *     audio/file      path of the WAV file written by the file sink
+ *     audio/fragSize  bytes per fragment
+ *     audio/frags     fragments buffered
+ *     audio/startFull wait for a full buffer before starting playback
+ *
+ * open() is called once, prepare() for each game, write() from
+ * the emulation thread and the rest from the UI thread.
+ * */
+class AudioSink
+{
+public:
+    struct Config
+    {
+        int rate;
+        int channels;
+        int frag_size;
+        int frags;
+        bool start_full;
+    };
+
+
+    virtual ~AudioSink() {}
+
+    virtual bool open(const Config &config) = 0;
+    virtual void prepare() = 0;
+    virtual void write(const int16_t *samples, int frames) = 0;
+    virtual void pause() = 0;
+    virtual void resume() = 0;
+    virtual void flush() = 0;
+
+    /* Audio written but not yet heard, in milliseconds. */
+    virtual int latency() = 0;
+
+    int underruns() const { return underrun_count; }
+
+
+    /*
+     *      The sink and configuration from the settings.
+     * */
+    static AudioSink *create(int rate);
+
+
+protected:
+    Config config;
+    int underrun_count = 0;
+
+    int frameBytes() const { return config.channels * sizeof(int16_t); }
+};
+
+
+
+/*
+ * Discards everything but plays in real time, so the emulator
+ * runs at the same speed as it would with a device.
+ * */
+class NullAudioSink: public AudioSink
+{
+    QElapsedTimer clock;
+    qint64 written = 0;
+
+protected:
+    /* Milliseconds of audio not yet due. */
+    qint64 ahead() const
+    {
+        return clock.isValid() ? written * 1000 / config.rate - clock.elapsed() : 0;
+    }
+
+public:
+    bool open(const Config &config) override
+    {
+        this->config = config;
+        return true;
+    }
+
+    void prepare() override
+    {
+        clock.invalidate();
+        written = 0;
+    }
+
+    void write(const int16_t *samples, int frames) override
+    {
+        Q_UNUSED(samples);
+
+        if(!clock.isValid())
+            clock.start();
+
+        // Block like a device would once its buffer is full.
+        const qint64 buffered = (qint64)config.frags * config.frag_size / frameBytes() * 1000 / config.rate;
+        const qint64 wait = ahead() - buffered;
+
+        if(wait > 0)
+            usleep(wait * 1000);
+        else if(ahead() < 0 && written)
+            underrun_count++;
+
+        if(ahead() < 0)
+        {
+            // Starved; start counting again from now.
+            clock.start();
+            written = 0;
+        }
+
+        written += frames;
+    }
+
+    void pause() override  { clock.invalidate(); written = 0; }
+    void resume() override {}
+    void flush() override  { prepare(); }
+
+    int latency() override { return qMax<qint64>(0, ahead()); }
+};
+
+
+
+/*
+ * A null sink that also keeps what it is given as a WAV file.
+ * */
+class FileAudioSink: public NullAudioSink
+{
+    QFile file;
+    quint32 data_size = 0;
+
+
+    void header()
+    {
+        const quint32 byte_rate = config.rate * frameBytes();
+        const quint16 align = frameBytes();
+        const quint16 bits = 16;
+        const quint16 pcm = 1;
+        const quint16 channels = config.channels;
+        const quint32 fmt_size = 16;
+        const quint32 riff_size = 36 + data_size;
+        const quint32 rate = config.rate;
+
+        file.seek(0);
+        file.write("RIFF", 4); file.write((const char *)&riff_size, 4);
+        file.write("WAVEfmt ", 8); file.write((const char *)&fmt_size, 4);
+        file.write((const char *)&pcm, 2); file.write((const char *)&channels, 2);
+        file.write((const char *)&rate, 4); file.write((const char *)&byte_rate, 4);
+        file.write((const char *)&align, 2); file.write((const char *)&bits, 2);
+        file.write("data", 4); file.write((const char *)&data_size, 4);
+        file.seek(file.size());
+    }
+
+
+public:
+    FileAudioSink(const QString &path): file(path)
+    {
+    }
+
+    ~FileAudioSink()
+    {
+        if(file.isOpen())
+            header();
+    }
+
+    bool open(const Config &config) override
+    {
+        NullAudioSink::open(config);
+
+        if(!file.open(QIODevice::WriteOnly | QIODevice::Truncate))
+            return false;
+
+        header();
+        return true;
+    }
+
+    void write(const int16_t *samples, int frames) override
+    {
+        data_size += file.write((const char *)samples, frames * frameBytes());
+        NullAudioSink::write(samples, frames);
+    }
+};
+
+
+
+#if defined(__QNX__)
+/*
+ * QNX Sound Architecture
+ *
+ * http://www.qnx.com/developers/docs/6.4.0/neutrino/audio/architecture.html
+ * http://www.qnx.com/developers/docs/6.4.0/neutrino/audio/pcm.html
+ * http://www.qnx.com/developers/docs/6.4.0/neutrino/audio/mixer.html
+ * */
+class QsaAudioSink: public AudioSink
+{
+    snd_pcm_t *pcm_handle = nullptr;
+
+
+    snd_pcm_channel_status_t status()
+    {
+        snd_pcm_channel_status_t status;
+
+        memset(&status, 0, sizeof(status));
+        status.channel = SND_PCM_CHANNEL_PLAYBACK;
+        snd_pcm_plugin_status(pcm_handle, &status);
+
+        return status;
+    }
+
+
+public:
+    ~QsaAudioSink()
+    {
+        if(pcm_handle)
+            snd_pcm_close(pcm_handle);
+    }
+
+    bool open(const Config &config) override
+    {
+        this->config = config;
+
+        snd_pcm_channel_params_t pp;
+
+        memset(&pp, 0, sizeof(snd_pcm_channel_params_t));
+        pp.mode       = SND_PCM_MODE_BLOCK;
+        pp.channel    = SND_PCM_CHANNEL_PLAYBACK;
+        pp.start_mode = config.start_full ? SND_PCM_START_FULL : SND_PCM_START_DATA;
+        pp.stop_mode  = SND_PCM_STOP_ROLLOVER_RESET;
+
+        pp.format.interleave = 1;
+        pp.format.rate       = config.rate;
+        pp.format.voices     = config.channels;
+        pp.format.format     = SND_PCM_SFMT_S16_LE;
+
+        pp.buf.block.frags_max = config.frags;
+        pp.buf.block.frags_min = 1;
+        pp.buf.block.frag_size = config.frag_size;
+
+        int snd_errno = -1;
+
+        snd_errno = snd_pcm_open_name(&pcm_handle, "pcmPreferred", SND_PCM_OPEN_PLAYBACK);
+        if( snd_errno < 0 )
+        {
+            fprintf( stderr, "snd_pcm_open_name failed: %s\n", snd_strerror(snd_errno) );
+            return false;
+        }
+
+        snd_errno = snd_pcm_plugin_params(pcm_handle, &pp);
+        if( snd_errno < 0 )
+        {
+            fprintf( stderr, "snd_pcm_plugin_params failed: %s\n", snd_strerror(snd_errno) );
+            return false;
+        }
+
+        return true;
+    }
+
+    void prepare() override
+    {
+        int snd_errno = -1;
+
+        snd_errno = snd_pcm_plugin_prepare(pcm_handle, SND_PCM_CHANNEL_PLAYBACK);
+        if( snd_errno < 0 )
+        {
+            fprintf( stderr, "snd_pcm_plugin_prepare failed: %s\n", snd_strerror(snd_errno) );
+        }
+    }
+
+    void write(const int16_t *samples, int frames) override
+    {
+        const int bytes = frames * frameBytes();
+        const int written = qMax(0, snd_pcm_plugin_write(pcm_handle, samples, bytes));
+
+        if(written < bytes)
+        {
+            const auto &current = status();
+
+            // Only what didn't make it before the underrun is written again.
+            if(current.status == SND_PCM_STATUS_UNDERRUN || current.status == SND_PCM_STATUS_READY)
+            {
+                underrun_count++;
+                prepare();
+                snd_pcm_plugin_write(pcm_handle, (const uint8_t *)samples + written, bytes - written);
+            }
+        }
+    }
+
+    void pause() override  { snd_pcm_channel_pause(pcm_handle, SND_PCM_CHANNEL_PLAYBACK); }
+    void resume() override { snd_pcm_channel_resume(pcm_handle, SND_PCM_CHANNEL_PLAYBACK); }
+    void flush() override  { snd_pcm_plugin_flush(pcm_handle, SND_PCM_CHANNEL_PLAYBACK); }
+
+    int latency() override
+    {
+        return status().count / frameBytes() * 1000 / config.rate;
+    }
+};
+#endif
+
+
+
+inline AudioSink *AudioSink::create(int rate)
+{
+    QSettings settings;
+
+#if defined(__QNX__)
+    const QString &name = settings.value("audio/sink", "qsa").toString();
+#else
+    const QString &name = settings.value("audio/sink", "null").toString();
+#endif
+
+    Config config;
+    config.rate       = rate;
+    config.channels   = 2;
+    config.frag_size  = settings.value("audio/fragSize", 2048).toInt();
+    config.frags      = settings.value("audio/frags", 5).toInt();
+    config.start_full = settings.value("audio/startFull", true).toBool();
+
+    AudioSink *sink = nullptr;
+
+#if defined(__QNX__)
+    if(name == "qsa")
+        sink = new QsaAudioSink();
+#endif
+    if(name == "file")
+        sink = new FileAudioSink( settings.value("audio/file", "data/audio.wav").toString() );
+
+    if(!sink)
+        sink = new NullAudioSink();
+
+    if(!sink->open(config))
+    {
+        fprintf( stderr, "AudioSink: %s did not open, audio is muted\n", name.toAscii().constData() );
+
+        delete sink;
+        sink = new NullAudioSink();
+        sink->open(config);
+    }
+
+    return sink;
+}
@@ -0,0 +1,76 @@
+/*
+ * AudioStretch.hpp
+ *
+ *  Created on: Oct 19, 2026
+ *      Author: swatson
+ */
+
+#pragma once
+
+#include <cmath>
+#include <cstdint>
+
+
+/*
+ * Stretches a block of interleaved 16 bit stereo by a ratio close to
+ * 1, run on the emulation thread just before the sink.
+ *
+ * FramePacer runs an NTSC game at one frame per vsync on a 60 Hz
+ * panel, 0.13% faster than the console, and the core still makes
+ * the console's number of samples per frame. Left alone that sound
+ * piles up in the sink until write() blocks the emulation thread.
+ * Stretching each block by FramePacer::audioRatio() gives the sink
+ * exactly the sample rate it plays.
+ *
+ * Output frames are linearly interpolated between neighbouring input
+ * frames. The last frame of a block and the fractional position are
+ * carried over, so blocks join without a seam.
+ * */
+class AudioStretch
+{
+    /* Where the next output frame falls; -1 is the last block's final frame. */
+    double position = 0.0;
+    int16_t last[2] = { 0, 0 };
+
+
+public:
+    //
+    //
+    void reset()
+    {
+        position = 0.0;
+        last[0] = last[1] = 0;
+    }
+
+
+    /*
+     *      Stretch frames of samples into out, which must have room
+     *      for frames * ratio + 1 frames. Returns the frames written.
+     * */
+    int process(const int16_t *samples, int frames, double ratio, int16_t *out)
+    {
+        if(frames <= 0)
+            return 0;
+
+        const double step = 1.0 / ratio;
+        int written = 0;
+
+        for(; position < frames - 1; position += step, written++)
+        {
+            const int i = (int)std::floor(position);
+            const int fraction = (int)((position - i) * 16384.0);
+
+            const int16_t *a = i < 0 ? last : samples + 2 * i;
+            const int16_t *b = samples + 2 * (i + 1);
+
+            *out++ = a[0] + (((b[0] - a[0]) * fraction) >> 14);
+            *out++ = a[1] + (((b[1] - a[1]) * fraction) >> 14);
+        }
+
+        position -= frames;
+        last[0] = samples[2 * (frames - 1)];
+        last[1] = samples[2 * (frames - 1) + 1];
+
+        return written;
+    }
+};
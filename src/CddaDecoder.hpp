@@ -0,0 +1,365 @@
+/*
+ * CddaDecoder.hpp
+ *
+ *  Created on: Oct 19, 2026
+ *      Author: swatson
+ */
+
+#pragma once
+
+#include "Trace.hpp"
+
+
+#include <stdio.h>
+#include <string.h>
+
+#ifdef MARKV_CDDA
+#include "DiscCache.hpp"
+#include <tremor/ivorbisfile.h>
+#endif
+
+
+#include <QMutex>
+#include <QThread>
+#include <QByteArray>
+#include <QElapsedTimer>
+#include <QWaitCondition>
+
+
+#ifdef MARKV_CDDA
+/* The core's calls land in the __wrap_ functions of CddaDecoderHooks.cpp, and so would ours. */
+extern "C" {
+long __real_ov_read(OggVorbis_File *vf, char *buffer, int length, int *bitstream);
+int __real_ov_pcm_seek(OggVorbis_File *vf, ogg_int64_t pos);
+ogg_int64_t __real_ov_pcm_tell(OggVorbis_File *vf);
+int __real_ov_clear(OggVorbis_File *vf);
+}
+
+
+/*
+ * Decodes the Sega CD's compressed audio tracks ahead of the CDD.
+ *
+ * With CONFIG+=cdda the core's Tremor calls are wrapped at link time
+ * (-Wl,--wrap) so the OGG track the CDD plays is decoded on a thread
+ * of its own into a RING_SIZE ring of PCM, just ahead of the play
+ * position. ov_read only copies out of the ring and ov_pcm_seek only
+ * moves the play position; the decoder seeks its own copy of the
+ * track and fills the ring from the target before the CDD asks.
+ * Only the track being played has a ring, so memory stays bounded
+ * whatever the length of the disc.
+ *
+ * The decoder opens the track again by name, which it gets from the
+ * DiscStream the core opened it through (see DiscCache.hpp), so the
+ * osd.h cdStream hooks must be in place too. The core only supports
+ * OGG audio tracks; FLAC isn't one of its formats.
+ *
+ * The emulation thread waits only when the ring is empty, right after
+ * a seek or when decoding falls behind, and those stalls are counted.
+ * */
+class CddaDecoder
+{
+public:
+    struct Stats
+    {
+        qint64 decoded;      // bytes of PCM
+        qint64 seeks;
+        qint64 stalls;
+        qint64 stall;        // total time the emulation thread waited (us)
+        qint64 worst_stall;  // longest single wait (us)
+    };
+
+
+private:
+    static constexpr auto RING_SIZE = 2 * 44100 * 4;   // two seconds of 16 bit stereo
+    static constexpr auto DECODE_SIZE = 4096;
+
+    class Decoder: public QThread
+    {
+        CddaDecoder *owner;
+
+        void run() override { owner->decode(); }
+
+    public:
+        Decoder(CddaDecoder *owner): owner(owner) { setObjectName("cdda decode"); }
+    };
+
+
+    QMutex mutex;
+    QWaitCondition wanted;
+    QWaitCondition decoded;
+
+    Decoder *decoder = nullptr;
+    bool stopping = false;
+
+    /* The core's track and where it is playing. */
+    OggVorbis_File *source = nullptr;
+    QByteArray path;
+    ogg_int64_t position = 0;
+    int generation = 0;
+    bool seek_pending = false;
+    bool ended = false;
+
+    /* PCM from position onward. */
+    QByteArray ring = QByteArray(RING_SIZE, 0);
+    int head = 0;
+    int filled = 0;
+
+    Stats counts = Stats();
+
+
+    /*
+     *      Decoder thread. Only it touches its own OggVorbis_File.
+     * */
+    void decode()
+    {
+        OggVorbis_File own;
+        QByteArray own_path;
+        bool open = false;
+        char pcm[DECODE_SIZE];
+
+        QMutexLocker lk(&mutex);
+
+        while(!stopping)
+        {
+            if(!source || (!seek_pending && (ended || filled == RING_SIZE)))
+            {
+                wanted.wait(&mutex);
+                continue;
+            }
+
+            const int current = generation;
+
+            if(seek_pending)
+            {
+                const QByteArray track = path;
+                const ogg_int64_t target = position;
+
+                lk.unlock();
+
+                if(open && own_path != track)
+                {
+                    __real_ov_clear(&own);
+                    open = false;
+                }
+
+                if(!open)
+                {
+                    FILE *file = fopen(track.constData(), "rb");
+                    open = file && !ov_open(file, &own, nullptr, 0);
+
+                    if(file && !open)
+                        fclose(file);
+
+                    own_path = track;
+                }
+
+                const bool ok = open && !__real_ov_pcm_seek(&own, target);
+
+                lk.relock();
+
+                if(current != generation)
+                    continue;
+
+                seek_pending = false;
+                ended = !ok;
+                head = 0;
+                filled = 0;
+                decoded.wakeAll();
+                continue;
+            }
+
+            const int space = qMin<int>(DECODE_SIZE, RING_SIZE - filled);
+            int bitstream = 0;
+
+            lk.unlock();
+            const long got = __real_ov_read(&own, pcm, space, &bitstream);
+            lk.relock();
+
+            if(current != generation)
+                continue;
+
+            if(got <= 0)
+                ended = true;
+
+            for(long i = 0, tail = (head + filled) % RING_SIZE; i < got; )
+            {
+                const long run = qMin<long>(got - i, RING_SIZE - tail);
+
+                memcpy(ring.data() + tail, pcm + i, run);
+                i += run;
+                tail = 0;
+            }
+
+            filled += qMax<long>(got, 0);
+            counts.decoded += qMax<long>(got, 0);
+            decoded.wakeAll();
+        }
+
+        if(open)
+            __real_ov_clear(&own);
+    }
+
+
+    /* Follow a new track or position; the caller holds the mutex. */
+    void retarget(OggVorbis_File *vf, ogg_int64_t target)
+    {
+        if(vf != source)
+        {
+            source = vf;
+            path = ((DiscStream *)vf->datasource)->path;
+        }
+
+        position = target;
+        generation++;
+        seek_pending = true;
+        ended = false;
+        head = 0;
+        filled = 0;
+
+        if(!decoder)
+        {
+            stopping = false;
+            decoder = new Decoder(this);
+            decoder->start();
+        }
+
+        wanted.wakeAll();
+    }
+
+
+public:
+    static CddaDecoder &instance()
+    {
+        static CddaDecoder decoder;
+        return decoder;
+    }
+
+
+    ~CddaDecoder()
+    {
+        stop();
+    }
+
+
+    /*
+     *      Nothing is playing any more; let the thread go.
+     * */
+    void stop()
+    {
+        QMutexLocker lk(&mutex);
+
+        if(!decoder)
+            return;
+
+        stopping = true;
+        source = nullptr;
+        wanted.wakeAll();
+
+        lk.unlock();
+        decoder->wait();
+        delete decoder;
+        lk.relock();
+
+        decoder = nullptr;
+    }
+
+
+    //
+    //
+    long read(OggVorbis_File *vf, char *buffer, int length)
+    {
+        QMutexLocker lk(&mutex);
+
+        // A track read before any seek starts where the core left it.
+        if(vf != source)
+            retarget(vf, __real_ov_pcm_tell(vf));
+
+        if(!filled && !ended)
+        {
+            QElapsedTimer timer;
+            timer.start();
+
+            while(!filled && !ended && source == vf)
+                decoded.wait(&mutex);
+
+            const qint64 stall = timer.nsecsElapsed();
+            TRACE_COMPLETE("CddaDecoder stall", stall);
+
+            counts.stalls++;
+            counts.stall += stall / 1000;
+            counts.worst_stall = qMax(counts.worst_stall, stall / 1000);
+        }
+
+        const int count = qMin(length, filled);
+
+        for(int i = 0; i < count; )
+        {
+            const int run = qMin(count - i, RING_SIZE - head);
+
+            memcpy(buffer + i, ring.constData() + head, run);
+            i += run;
+            head = (head + run) % RING_SIZE;
+        }
+
+        filled -= count;
+        position += count / 4;
+        wanted.wakeAll();
+
+        return count;
+    }
+
+
+    //
+    //
+    int seek(OggVorbis_File *vf, ogg_int64_t target)
+    {
+        QMutexLocker lk(&mutex);
+
+        counts.seeks++;
+        retarget(vf, target);
+
+        return 0;
+    }
+
+
+    bool tell(OggVorbis_File *vf, ogg_int64_t *at)
+    {
+        QMutexLocker lk(&mutex);
+
+        if(vf != source)
+            return false;
+
+        *at = position;
+        return true;
+    }
+
+
+    //
+    //
+    void forget(OggVorbis_File *vf)
+    {
+        QMutexLocker lk(&mutex);
+
+        if(vf != source)
+            return;
+
+        lk.unlock();
+        stop();
+    }
+
+
+    /*
+     *      Since the last call.
+     * */
+    Stats take()
+    {
+        QMutexLocker lk(&mutex);
+
+        const Stats stats = counts;
+        counts = Stats();
+
+        return stats;
+    }
+};
+
+#endif
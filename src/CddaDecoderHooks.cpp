@@ -0,0 +1,42 @@
+/*
+ * CddaDecoderHooks.cpp
+ *
+ *  Created on: Oct 19, 2026
+ *      Author: swatson
+ */
+
+#include "CddaDecoder.hpp"
+
+
+/*
+ * The wrapped Tremor functions (see CddaDecoder.hpp). Only compiled
+ * with CONFIG+=cdda, which links the core with the --wrap flags.
+ * */
+extern "C" {
+
+long __wrap_ov_read(OggVorbis_File *vf, char *buffer, int length, int *bitstream)
+{
+    if(bitstream)
+        *bitstream = 0;
+
+    return CddaDecoder::instance().read(vf, buffer, length);
+}
+
+int __wrap_ov_pcm_seek(OggVorbis_File *vf, ogg_int64_t pos)
+{
+    return CddaDecoder::instance().seek(vf, pos);
+}
+
+ogg_int64_t __wrap_ov_pcm_tell(OggVorbis_File *vf)
+{
+    ogg_int64_t at;
+    return CddaDecoder::instance().tell(vf, &at) ? at : __real_ov_pcm_tell(vf);
+}
+
+int __wrap_ov_clear(OggVorbis_File *vf)
+{
+    CddaDecoder::instance().forget(vf);
+    return __real_ov_clear(vf);
+}
+
+}
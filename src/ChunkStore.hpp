@@ -0,0 +1,290 @@
+/*
+ * ChunkStore.hpp
+ *
+ *  Created on: Oct 19, 2026
+ *      Author: swatson
+ */
+
+#pragma once
+
+#include <QDir>
+#include <QSet>
+#include <QFile>
+#include <QHash>
+#include <QList>
+#include <QMutex>
+#include <QString>
+#include <QVector>
+#include <QByteArray>
+#include <QStringList>
+#include <QCryptographicHash>
+
+
+/*
+ * A per game directory of content addressed state chunks.
+ *
+ * A state is cut into CHUNK_SIZE pieces and each piece is stored
+ * once under its SHA-1, so the many parts of RAM that do not
+ * change between saves cost nothing after the first one. A state
+ * is then just its list of hashes (the manifest).
+ *
+ * A new chunk is stored either whole or, when the last state saved
+ * to the store had a whole chunk at the same offset, as the zlib
+ * compressed XOR against that chunk. Mostly equal chunks XOR to
+ * mostly zeros, which compress far better than the chunk itself.
+ * Deltas only ever refer to whole chunks so a read is at most two
+ * files deep.
+ *
+ *     'F' qCompress(chunk)
+ *     'D' base hash (20 bytes) qCompress(chunk ^ base)
+ *
+ * All functions are safe to call from any thread.
+ * */
+class ChunkStore
+{
+    static constexpr auto CHUNK_SIZE = 16 * 1024;
+    static constexpr auto HASH_SIZE = 20;
+
+    /* The whole chunks the last saved state can be diffed against. */
+    struct Base
+    {
+        QString dir;
+        QVector<QByteArray> hashes;
+        QVector<QByteArray> chunks;
+    };
+
+    static QMutex &mutex()
+    {
+        static QMutex mutex;
+        return mutex;
+    }
+
+    static Base &base()
+    {
+        static Base base;
+        return base;
+    }
+
+
+    /* Stores with a snapshot being written, whose manifest isn't on disk yet. */
+    static QHash<QString, int> &pins()
+    {
+        static QHash<QString, int> pins;
+        return pins;
+    }
+
+
+    static QString path(const QString &dir, const QByteArray &hash)
+    {
+        return dir + "/" + hash.toHex();
+    }
+
+
+    static QByteArray exclusiveOr(const QByteArray &a, const QByteArray &b)
+    {
+        QByteArray out(a);
+        const int n = qMin(a.size(), b.size());
+
+        for(int i = 0; i < n; i++)
+            out[i] = out[i] ^ b[i];
+
+        return out;
+    }
+
+
+    static bool put(const QString &file, const QByteArray &data)
+    {
+        QFile out(file + ".tmp");
+
+        if(!out.open(QIODevice::WriteOnly | QIODevice::Truncate) || out.write(data) != data.size())
+        {
+            out.remove();
+            return false;
+        }
+
+        out.close();
+        return out.rename(file);
+    }
+
+
+    static QByteArray get(const QString &dir, const QByteArray &hash)
+    {
+        QFile in(path(dir, hash));
+
+        if(!in.open(QIODevice::ReadOnly))
+            return QByteArray();
+
+        const QByteArray &data = in.readAll();
+
+        if(data.startsWith('F'))
+            return qUncompress(data.mid(1));
+
+        if(data.startsWith('D') && data.size() > 1 + HASH_SIZE)
+        {
+            const QByteArray &whole = get(dir, data.mid(1, HASH_SIZE));
+
+            if(!whole.isEmpty())
+                return exclusiveOr(qUncompress(data.mid(1 + HASH_SIZE)), whole);
+        }
+
+        return QByteArray();
+    }
+
+
+public:
+    struct Stats
+    {
+        int chunks;
+        int written;
+        int deltas;
+        qint64 bytes;
+    };
+
+
+    /*
+     *      Store a state and return its manifest. Empty on failure.
+     * */
+    static QList<QByteArray> store(const QString &dir, const QByteArray &state, Stats *stats = nullptr)
+    {
+        QMutexLocker lk(&mutex());
+        QList<QByteArray> manifest;
+        Base &last = base();
+        Stats counts = { 0, 0, 0, 0 };
+
+        QDir().mkpath(dir);
+
+        if(last.dir != dir)
+        {
+            last.dir = dir;
+            last.hashes.clear();
+            last.chunks.clear();
+        }
+
+        const int count = (state.size() + CHUNK_SIZE - 1) / CHUNK_SIZE;
+        last.hashes.resize(qMax(last.hashes.size(), count));
+        last.chunks.resize(qMax(last.chunks.size(), count));
+
+        for(int i = 0; i < count; i++)
+        {
+            const QByteArray &chunk = state.mid(i * CHUNK_SIZE, CHUNK_SIZE);
+            const QByteArray &hash = QCryptographicHash::hash(chunk, QCryptographicHash::Sha1);
+            const QString &file = path(dir, hash);
+
+            manifest << hash;
+            counts.chunks++;
+
+            if(QFile::exists(file))
+                continue;
+
+            QByteArray data;
+
+            if(!last.chunks[i].isEmpty() && last.chunks[i].size() == chunk.size())
+            {
+                data = 'D' + last.hashes[i] + qCompress(exclusiveOr(chunk, last.chunks[i]), 6);
+                counts.deltas++;
+            }
+            else
+            {
+                data = 'F' + qCompress(chunk, 6);
+
+                last.hashes[i] = hash;
+                last.chunks[i] = chunk;
+            }
+
+            if(!put(file, data))
+                return QList<QByteArray>();
+
+            counts.written++;
+            counts.bytes += data.size();
+        }
+
+        if(stats)
+            *stats = counts;
+
+        return manifest;
+    }
+
+
+    /*
+     *      Put a state back together. Empty if a chunk is missing.
+     * */
+    static QByteArray load(const QString &dir, const QList<QByteArray> &manifest)
+    {
+        QByteArray state;
+        state.reserve(manifest.size() * CHUNK_SIZE);
+
+        for(const auto &hash : manifest)
+        {
+            const QByteArray &chunk = get(dir, hash);
+
+            if(chunk.isEmpty())
+                return QByteArray();
+
+            state += chunk;
+        }
+
+        return state;
+    }
+
+
+    /*
+     *      Keep collect() away from a store while a snapshot is
+     *      between storing its chunks and writing its manifest.
+     * */
+    static void pin(const QString &dir)
+    {
+        QMutexLocker lk(&mutex());
+        pins()[dir]++;
+    }
+
+
+    static void unpin(const QString &dir)
+    {
+        QMutexLocker lk(&mutex());
+
+        if(--pins()[dir] <= 0)
+            pins().remove(dir);
+    }
+
+
+    /*
+     *      Delete every chunk not needed by one of the manifests,
+     *      and the directory itself when nothing is left. Does
+     *      nothing while the store is pinned; the snapshot that
+     *      pinned it collects again once written.
+     * */
+    static void collect(const QString &dir, const QList<QList<QByteArray>> &manifests)
+    {
+        QMutexLocker lk(&mutex());
+        QSet<QString> live;
+
+        if(pins().contains(dir))
+            return;
+
+        for(const auto &manifest : manifests)
+        {
+            for(const auto &hash : manifest)
+            {
+                live.insert(hash.toHex());
+
+                // A delta keeps its whole chunk alive too.
+                QFile in(path(dir, hash));
+                if(in.open(QIODevice::ReadOnly) && in.read(1) == "D")
+                    live.insert(in.read(HASH_SIZE).toHex());
+            }
+        }
+
+        QDir store(dir);
+
+        for(const auto &name : store.entryList(QDir::Files))
+            if(!live.contains(name))
+                store.remove(name);
+
+        if(live.isEmpty())
+            QDir().rmdir(dir);
+
+        // Deltas may no longer be made against deleted chunks.
+        if(base().dir == dir)
+            base() = Base();
+    }
+};
@@ -0,0 +1,258 @@
+/*
+ * CoverPreview.hpp
+ *
+ *  Created on: Oct 19, 2026
+ *      Author: swatson
+ */
+
+#pragma once
+
+extern "C" {
+#ifndef Q_MOC_RUN
+#include <shared.h>
+#endif
+}
+
+#include <vector>
+#include <cstdint>
+
+#if defined(__ARM_NEON__)
+#include <arm_neon.h>
+#elif defined(__SSE2__)
+#include <emmintrin.h>
+#endif
+
+
+#include <QMutex>
+#include <QTimer>
+#include <QObject>
+#include <QAtomicInt>
+
+#include <bb/ImageData>
+#include <bb/PixelFormat>
+
+#include <bb/cascades/Image>
+#include <bb/cascades/ImageView>
+#include <bb/cascades/SceneCover>
+#include <bb/cascades/Application>
+
+#include "FramePipeline.hpp"
+
+using namespace bb::cascades;
+
+
+/*
+ * Shows the running game in the active frame while the app is
+ * minimized. The cover is only refreshed a few times a second
+ * from a half size copy of the latest finished frame.
+ *
+ * The core keeps drawing on the emulation thread meanwhile, so the
+ * frame is never read from bitmap directly: with a FramePipeline open
+ * it is read from the pipeline under its lock, otherwise the
+ * emulation thread shrinks it between frames when capture() is asked
+ * to and the next refresh shows it.
+ * */
+class CoverPreview: public QObject
+{
+    Q_OBJECT
+
+    static constexpr auto UPDATE_INTERVAL = 250;
+
+    SceneCover *cover = nullptr;
+    ImageView *image_view = nullptr;
+    QTimer *timer = new QTimer(this);
+
+    FramePipeline *pipeline;
+    QAtomicInt capture_pending;
+
+    QMutex mutex;
+    std::vector<uint16_t> half;
+    int half_w = 0;
+    int half_h = 0;
+
+
+    /* Average two RGB565 pixels per channel without unpacking them. */
+    static inline uint16_t average(uint16_t a, uint16_t b)
+    {
+        return (a & b) + (((a ^ b) & 0xF7DE) >> 1);
+    }
+
+
+    /*
+     *      Keep a half size copy of a frame's viewport.
+     * */
+    void shrink(const uint8_t *frame, int pitch, int width, int height)
+    {
+        const int w = width & ~15;
+        const int h = height & ~1;
+
+        if(w <= 0 || h <= 0 || !frame)
+            return;
+
+        QMutexLocker lk(&mutex);
+
+        half.resize( (w / 2) * (h / 2) );
+        half_w = w / 2;
+        half_h = h / 2;
+        downscale( frame, pitch, w, h, half.data() );
+    }
+
+
+    Q_SLOT void update()
+    {
+        const bool read = pipeline->readLatest( [this](const uint8_t *frame, int pitch, int width, int height)
+        {
+            shrink(frame, pitch, width, height);
+        });
+
+        if(!read)
+            capture_pending = 1;
+
+        QMutexLocker lk(&mutex);
+
+        if(half.empty())
+            return;
+
+        bb::ImageData image_data( bb::PixelFormat::RGBX, half_w, half_h );
+        const uint16_t *src = half.data();
+
+        for(int y = 0; y < half_h; y++)
+        {
+            unsigned char *dst = image_data.pixels() + y * image_data.bytesPerLine();
+
+            for(int x = 0; x < half_w; x++, src++)
+            {
+                *dst++ = ((*src >> 8) & 0xf8) | (*src >> 13);
+                *dst++ = ((*src >> 3) & 0xfc) | ((*src >> 9) & 0x03);
+                *dst++ = ((*src << 3) & 0xf8) | ((*src >> 2) & 0x07);
+                *dst++ = 0xff;
+            }
+        }
+
+        image_view->setImage( Image(image_data) );
+    }
+
+
+public:
+    /*
+     *      Box filter an RGB565 frame to half size. The width must be
+     *      a multiple of 16 and the height a multiple of 2.
+     * */
+    static void downscale(const uint8_t *src, int pitch, int width, int height, uint16_t *dst)
+    {
+        for(int y = 0; y < height; y += 2)
+        {
+            const uint16_t *row0 = (const uint16_t *)(src + y * pitch);
+            const uint16_t *row1 = (const uint16_t *)(src + (y + 1) * pitch);
+            int x = 0;
+
+#if defined(__ARM_NEON__)
+            const uint16x8_t mask = vdupq_n_u16(0xF7DE);
+
+            for(; x < width; x += 16, dst += 8)
+            {
+                const uint16x8x2_t a = vld2q_u16(row0 + x);
+                const uint16x8x2_t b = vld2q_u16(row1 + x);
+
+                /* Vertical pairs first, then the even and odd columns. */
+                const uint16x8_t even = vaddq_u16( vandq_u16(a.val[0], b.val[0]), vshrq_n_u16( vandq_u16(veorq_u16(a.val[0], b.val[0]), mask), 1 ) );
+                const uint16x8_t odd  = vaddq_u16( vandq_u16(a.val[1], b.val[1]), vshrq_n_u16( vandq_u16(veorq_u16(a.val[1], b.val[1]), mask), 1 ) );
+
+                vst1q_u16( dst, vaddq_u16( vandq_u16(even, odd), vshrq_n_u16( vandq_u16(veorq_u16(even, odd), mask), 1 ) ) );
+            }
+#elif defined(__SSE2__)
+            const __m128i mask = _mm_set1_epi16((short)0xF7DE);
+
+            for(; x < width; x += 16, dst += 8)
+            {
+                __m128i out[2];
+
+                for(int i = 0; i < 2; i++)
+                {
+                    /* Vertical pairs first, then neighbours within each 32 bit lane. */
+                    const __m128i a = _mm_loadu_si128( (const __m128i *)(row0 + x + i * 8) );
+                    const __m128i b = _mm_loadu_si128( (const __m128i *)(row1 + x + i * 8) );
+                    const __m128i v = _mm_add_epi16( _mm_and_si128(a, b), _mm_srli_epi16( _mm_and_si128(_mm_xor_si128(a, b), mask), 1 ) );
+                    const __m128i o = _mm_srli_epi32(v, 16);
+                    const __m128i h = _mm_add_epi16( _mm_and_si128(v, o), _mm_srli_epi16( _mm_and_si128(_mm_xor_si128(v, o), mask), 1 ) );
+
+                    /* Sign extend the low halves so the signed pack keeps every bit. */
+                    out[i] = _mm_srai_epi32( _mm_slli_epi32(h, 16), 16 );
+                }
+
+                _mm_storeu_si128( (__m128i *)dst, _mm_packs_epi32(out[0], out[1]) );
+            }
+#endif
+
+            for(; x < width; x += 2, dst++)
+                *dst = average( average(row0[x], row1[x]), average(row0[x + 1], row1[x + 1]) );
+        }
+    }
+
+
+    CoverPreview(FramePipeline *pipeline, QObject *parent = nullptr): QObject(parent), pipeline(pipeline)
+    {
+        timer->setInterval(UPDATE_INTERVAL);
+
+        bool connection;
+        connection = connect( timer, SIGNAL(timeout()), this, SLOT(update()) );
+        Q_ASSERT( connection );
+        Q_UNUSED( connection );
+    }
+
+
+    ~CoverPreview()
+    {
+        stop();
+    }
+
+
+    /*
+     *      Emulation thread, between frames: shrink bitmap's frame if
+     *      the last refresh asked for it.
+     * */
+    void capture()
+    {
+        if(capture_pending.fetchAndStoreOrdered(0))
+            shrink( bitmap.data + bitmap.viewport.y * bitmap.pitch + bitmap.viewport.x * sizeof(uint16_t),
+                    bitmap.pitch, bitmap.viewport.w, bitmap.viewport.h );
+    }
+
+
+    //
+    //
+    Q_SLOT void start()
+    {
+        if(!cover)
+        {
+            image_view = ImageView::create().scalingMethod( ScalingMethod::AspectFill );
+            cover = SceneCover::create().content( image_view );
+            Application::instance()->setCover( cover );
+        }
+
+        update();
+        timer->start();
+    }
+
+
+    //
+    //
+    Q_SLOT void stop()
+    {
+        timer->stop();
+        capture_pending = 0;
+
+        {
+            QMutexLocker lk(&mutex);
+            std::vector<uint16_t>().swap(half);
+        }
+
+        if(cover)
+        {
+            Application::instance()->setCover( 0 );
+            delete cover;
+            cover = nullptr;
+            image_view = nullptr;
+        }
+    }
+};
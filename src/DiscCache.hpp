@@ -0,0 +1,493 @@
+/*
+ * DiscCache.hpp
+ *
+ *  Created on: Oct 19, 2026
+ *      Author: swatson
+ */
+
+#pragma once
+
+#include "Trace.hpp"
+
+
+#include <fcntl.h>
+#include <stdio.h>
+#include <unistd.h>
+#include <string.h>
+#include <sys/stat.h>
+
+
+#include <QHash>
+#include <QList>
+#include <QMutex>
+#include <QQueue>
+#include <QThread>
+#include <QString>
+#include <QByteArray>
+#include <QElapsedTimer>
+#include <QWaitCondition>
+
+
+/*
+ * Read-ahead for Sega CD disc images.
+ *
+ * The CDD reads sectors in the middle of system_frame_scd, and with
+ * plain stdio a seek or the first read of a new FMV stretch goes to
+ * storage right there. Here every read is served from a cache of
+ * BLOCK_SIZE blocks and a reader thread keeps the next AHEAD blocks
+ * after the last one read coming in, so it follows the CDD's read
+ * position. A read that jumps somewhere new drops the read-ahead for
+ * the old position and starts again from there.
+ *
+ * The emulation thread only touches storage itself when a block is
+ * neither cached nor on its way (a miss), and only waits when the
+ * block it wants is being read (a wait). Both count as stalls.
+ *
+ * Built in with CONFIG+=disccache (MARKV_DISCCACHE). The core
+ * reaches the cache through the cdStream hooks of its osd.h, which
+ * lives with the core in genlib rather than here, so the option is
+ * only any use with a genlib built with:
+ *
+ *     typedef struct DiscStream DiscStream;
+ *     DiscStream *markv_cd_open(const char *fname);
+ *     ...
+ *     #define cdStream            DiscStream
+ *     #define cdStreamOpen(fname) markv_cd_open(fname)
+ *     #define cdStreamClose       markv_cd_close
+ *     #define cdStreamRead        markv_cd_read
+ *     #define cdStreamSeek        markv_cd_seek
+ *     #define cdStreamTell        markv_cd_tell
+ *     #define cdStreamGets        markv_cd_gets
+ *
+ * The hooks themselves are in DiscCacheHooks.cpp.
+ *
+ * What goes through cdStream, and so through the cache: the CUE
+ * sheet, BIN and ISO data tracks, and the WAV and OGG audio tracks a
+ * CUE lists. CHD images don't; the core reads those through libchdr
+ * and its own file I/O, so they get no read-ahead.
+ * */
+struct DiscStream
+{
+    int id;
+    int fd;
+    qint64 size;
+    qint64 position;
+    QByteArray path;
+};
+
+
+class DiscCache
+{
+public:
+    struct Stats
+    {
+        qint64 hits;
+        qint64 misses;
+        qint64 waits;
+        qint64 stall;        // total time the emulation thread waited (us)
+        qint64 worst_stall;  // longest single wait (us)
+    };
+
+
+private:
+    static constexpr auto BLOCK_SIZE = 64 * 1024;
+    static constexpr auto AHEAD = 8;
+    static constexpr auto CAPACITY = 48;
+
+    struct Block
+    {
+        QByteArray data;
+        qint64 used;
+        bool ready;
+    };
+
+
+    class Reader: public QThread
+    {
+        DiscCache *cache;
+
+        void run() override { cache->readAhead(); }
+
+    public:
+        Reader(DiscCache *cache): cache(cache) { setObjectName("disc read-ahead"); }
+    };
+
+
+    QMutex mutex;
+    QWaitCondition requested;
+    QWaitCondition loaded;
+
+    QHash<int, DiscStream*> streams;
+    QHash<quint64, Block> blocks;
+    QQueue<quint64> queue;
+
+    Reader *reader = nullptr;
+    bool stopping = false;
+    int next_id = 1;
+    qint64 tick = 0;
+
+    Stats counts = Stats();
+
+
+    static quint64 key(int stream, qint64 block)
+    {
+        return ((quint64)stream << 40) | (quint64)block;
+    }
+
+
+    static QByteArray load(int fd, qint64 block, qint64 size)
+    {
+        QByteArray data( qMin<qint64>(BLOCK_SIZE, size - block * BLOCK_SIZE), 0 );
+        const ssize_t got = pread(fd, data.data(), data.size(), block * BLOCK_SIZE);
+
+        data.resize( qMax<ssize_t>(got, 0) );
+        return data;
+    }
+
+
+    /* Make room for one more block; the caller holds the mutex. */
+    void evict()
+    {
+        while(blocks.size() >= CAPACITY)
+        {
+            auto oldest = blocks.end();
+
+            for(auto it = blocks.begin(); it != blocks.end(); ++it)
+                if(it->ready && (oldest == blocks.end() || it->used < oldest->used))
+                    oldest = it;
+
+            if(oldest == blocks.end())
+                return;
+
+            blocks.erase(oldest);
+        }
+    }
+
+
+    /* Queue the blocks after this one; the caller holds the mutex. */
+    void requestAhead(DiscStream *stream, qint64 block)
+    {
+        const qint64 last = (stream->size - 1) / BLOCK_SIZE;
+
+        for(qint64 next = block + 1; next <= qMin(last, block + AHEAD); next++)
+        {
+            const quint64 k = key(stream->id, next);
+
+            if(blocks.contains(k) || queue.contains(k))
+                continue;
+
+            queue.enqueue(k);
+        }
+
+        requested.wakeOne();
+    }
+
+
+    void readAhead()
+    {
+        QMutexLocker lk(&mutex);
+
+        while(!stopping)
+        {
+            if(queue.isEmpty())
+            {
+                requested.wait(&mutex);
+                continue;
+            }
+
+            const quint64 k = queue.dequeue();
+            DiscStream *stream = streams.value(k >> 40);
+
+            if(!stream || blocks.contains(k))
+                continue;
+
+            evict();
+
+            Block &pending = blocks[k];
+            pending.used = ++tick;
+            pending.ready = false;
+
+            const int fd = stream->fd;
+            const qint64 size = stream->size;
+
+            lk.unlock();
+            const QByteArray &data = load(fd, k & ((1ull << 40) - 1), size);
+            lk.relock();
+
+            if(blocks.contains(k))
+            {
+                blocks[k].data = data;
+                blocks[k].ready = true;
+            }
+
+            loaded.wakeAll();
+        }
+    }
+
+
+    /*
+     *      The block, from the cache if at all possible; the caller
+     *      holds the mutex. Each call is one lookup for the stats.
+     * */
+    const QByteArray &block(QMutexLocker &lk, DiscStream *stream, qint64 index)
+    {
+        const quint64 k = key(stream->id, index);
+        auto it = blocks.find(k);
+
+        if(it != blocks.end() && it->ready)
+        {
+            counts.hits++;
+        }
+        else
+        {
+            QElapsedTimer timer;
+            timer.start();
+
+            if(it != blocks.end())
+            {
+                counts.waits++;
+
+                while(blocks.contains(k) && !blocks[k].ready)
+                    loaded.wait(&mutex);
+            }
+
+            if(!blocks.contains(k))
+            {
+                // Somewhere new: what was queued is for the old position.
+                counts.misses++;
+
+                for(int i = queue.size() - 1; i >= 0; i--)
+                    if((queue[i] >> 40) == (quint64)stream->id)
+                        queue.removeAt(i);
+
+                lk.unlock();
+                const QByteArray &data = load(stream->fd, index, stream->size);
+                lk.relock();
+
+                evict();
+                blocks[k].data = data;
+                blocks[k].ready = true;
+            }
+
+            const qint64 stall = timer.nsecsElapsed();
+            TRACE_COMPLETE("DiscCache stall", stall);
+
+            counts.stall += stall / 1000;
+            counts.worst_stall = qMax(counts.worst_stall, stall / 1000);
+        }
+
+        Block &found = blocks[k];
+        found.used = ++tick;
+
+        requestAhead(stream, index);
+
+        return found.data;
+    }
+
+
+public:
+    static DiscCache &instance()
+    {
+        static DiscCache cache;
+        return cache;
+    }
+
+
+    ~DiscCache()
+    {
+        QMutexLocker lk(&mutex);
+
+        for(auto *stream : streams)
+        {
+            ::close(stream->fd);
+            delete stream;
+        }
+
+        streams.clear();
+    }
+
+
+    DiscStream *open(const char *file)
+    {
+        const int fd = ::open(file, O_RDONLY);
+        struct stat info;
+
+        if(fd < 0)
+            return nullptr;
+
+        if(fstat(fd, &info))
+        {
+            ::close(fd);
+            return nullptr;
+        }
+
+        QMutexLocker lk(&mutex);
+
+        DiscStream *stream = new DiscStream;
+        stream->id = next_id++;
+        stream->fd = fd;
+        stream->size = info.st_size;
+        stream->position = 0;
+        stream->path = file;
+        streams.insert(stream->id, stream);
+
+        if(!reader)
+        {
+            stopping = false;
+            reader = new Reader(this);
+            reader->start(QThread::LowPriority);
+        }
+
+        return stream;
+    }
+
+
+    void close(DiscStream *stream)
+    {
+        QMutexLocker lk(&mutex);
+
+        streams.remove(stream->id);
+
+        for(auto it = blocks.begin(); it != blocks.end(); )
+            it = (it.key() >> 40) == (quint64)stream->id && it->ready ? blocks.erase(it) : it + 1;
+
+        // The reader may still be loading one of its blocks from the fd.
+        while(true)
+        {
+            bool busy = false;
+            for(auto it = blocks.constBegin(); it != blocks.constEnd(); ++it)
+                busy |= (it.key() >> 40) == (quint64)stream->id;
+
+            if(!busy)
+                break;
+
+            loaded.wait(&mutex);
+
+            for(auto it = blocks.begin(); it != blocks.end(); )
+                it = (it.key() >> 40) == (quint64)stream->id && it->ready ? blocks.erase(it) : it + 1;
+        }
+
+        ::close(stream->fd);
+        delete stream;
+
+        if(streams.isEmpty() && reader)
+        {
+            stopping = true;
+            queue.clear();
+            requested.wakeAll();
+
+            lk.unlock();
+            reader->wait();
+            delete reader;
+            lk.relock();
+
+            reader = nullptr;
+        }
+    }
+
+
+    size_t read(void *buffer, size_t size, size_t count, DiscStream *stream)
+    {
+        QMutexLocker lk(&mutex);
+
+        qint64 wanted = qMin<qint64>(size * count, stream->size - stream->position);
+        char *out = (char *)buffer;
+        size_t done = 0;
+
+        while(wanted > 0)
+        {
+            const qint64 index = stream->position / BLOCK_SIZE;
+            const qint64 offset = stream->position % BLOCK_SIZE;
+            const QByteArray &data = block(lk, stream, index);
+            const qint64 length = qMin<qint64>(wanted, data.size() - offset);
+
+            if(length <= 0)
+                break;
+
+            memcpy(out + done, data.constData() + offset, length);
+
+            done += length;
+            wanted -= length;
+            stream->position += length;
+        }
+
+        return size ? done / size : 0;
+    }
+
+
+    int seek(DiscStream *stream, long offset, int origin)
+    {
+        QMutexLocker lk(&mutex);
+
+        const qint64 base = origin == SEEK_CUR ? stream->position : origin == SEEK_END ? stream->size : 0;
+
+        if(base + offset < 0)
+            return -1;
+
+        stream->position = base + offset;
+        return 0;
+    }
+
+
+    long tell(DiscStream *stream)
+    {
+        QMutexLocker lk(&mutex);
+        return stream->position;
+    }
+
+
+    /*
+     *      Like fgets. The line is looked for in each block, so a
+     *      CUE sheet costs a lookup per block rather than per byte.
+     * */
+    char *gets(char *buffer, int size, DiscStream *stream)
+    {
+        QMutexLocker lk(&mutex);
+
+        int length = 0;
+
+        while(length < size - 1 && stream->position < stream->size)
+        {
+            const qint64 index = stream->position / BLOCK_SIZE;
+            const qint64 offset = stream->position % BLOCK_SIZE;
+            const QByteArray &data = block(lk, stream, index);
+            const qint64 available = qMin<qint64>(size - 1 - length, data.size() - offset);
+
+            if(available <= 0)
+                break;
+
+            const char *start = data.constData() + offset;
+            const char *newline = (const char *)memchr(start, '\n', available);
+            const qint64 taken = newline ? newline - start + 1 : available;
+
+            memcpy(buffer + length, start, taken);
+
+            length += taken;
+            stream->position += taken;
+
+            if(newline)
+                break;
+        }
+
+        if(!length)
+            return nullptr;
+
+        buffer[length] = 0;
+        return buffer;
+    }
+
+
+    /*
+     *      Since the last call.
+     * */
+    Stats take()
+    {
+        QMutexLocker lk(&mutex);
+
+        const Stats stats = counts;
+        counts = Stats();
+
+        return stats;
+    }
+};
+
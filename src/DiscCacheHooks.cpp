@@ -0,0 +1,48 @@
+/*
+ * DiscCacheHooks.cpp
+ *
+ *  Created on: Oct 19, 2026
+ *      Author: swatson
+ */
+
+#include "DiscCache.hpp"
+
+
+/*
+ * The cdStream hooks a genlib built for the cache calls (see
+ * DiscCache.hpp). Only compiled with CONFIG+=disccache.
+ * */
+extern "C" {
+
+DiscStream *markv_cd_open(const char *fname)
+{
+    return DiscCache::instance().open(fname);
+}
+
+int markv_cd_close(DiscStream *stream)
+{
+    DiscCache::instance().close(stream);
+    return 0;
+}
+
+size_t markv_cd_read(void *buffer, size_t size, size_t count, DiscStream *stream)
+{
+    return DiscCache::instance().read(buffer, size, count, stream);
+}
+
+int markv_cd_seek(DiscStream *stream, long offset, int origin)
+{
+    return DiscCache::instance().seek(stream, offset, origin);
+}
+
+long markv_cd_tell(DiscStream *stream)
+{
+    return DiscCache::instance().tell(stream);
+}
+
+char *markv_cd_gets(char *buffer, int size, DiscStream *stream)
+{
+    return DiscCache::instance().gets(buffer, size, stream);
+}
+
+}
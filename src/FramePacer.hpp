@@ -0,0 +1,232 @@
+/*
+ * FramePacer.hpp
+ *
+ *  Created on: Oct 19, 2026
+ *      Author: swatson
+ */
+
+#pragma once
+
+#include <cmath>
+
+
+#include <QMutex>
+#include <QElapsedTimer>
+#include <QWaitCondition>
+
+
+/*
+ * Ties emulated frames to the display's refresh.
+ *
+ * The video thread calls vsync() every time a post returns, which
+ * makes the display the one clock everything runs on. Each vsync
+ * earns the emulation thread emulated/refresh frames of credit and
+ * wait() hands out one whole frame at a time:
+ *
+ *     NTSC (59.92 Hz) on a 60 Hz panel: exactly one frame per vsync,
+ *         rates within 1% of each other are treated as equal.
+ *         The game then runs that much fast, and audioRatio() says
+ *         how much to stretch its sound to make up for it.
+ *     PAL (49.70 Hz) on a 60 Hz panel: five frames every six vsyncs.
+ *
+ * The refresh interval is estimated from the vsyncs themselves, so
+ * a presenter that paces to a fake display works the same way. A
+ * vsync that comes a whole refresh or more late earns the frames of
+ * every refresh it stands for, up to MAX_PENDING, so a missed vsync
+ * doesn't slow the game down. The interval is rounded to whole
+ * refreshes so jitter doesn't move credit between vsyncs. A gap of
+ * several intervals (a pause) starts the credit over rather than
+ * making the emulator catch up.
+ * */
+class FramePacer
+{
+public:
+    struct Stats
+    {
+        double refresh;   // estimated display rate (Hz)
+        qint64 vsyncs;
+        qint64 interval;  // mean time between vsyncs (us)
+        qint64 jitter;    // standard deviation of that (us)
+        qint64 worst;     // furthest a vsync was from the estimate (us)
+        qint64 missed;    // vsyncs more than half an interval late
+        qint64 repeated;  // vsyncs that showed the last frame again
+        qint64 late;      // frames skipped because emulation fell behind
+    };
+
+
+private:
+    /* How far emulation may fall behind before frames are skipped. */
+    static constexpr auto MAX_PENDING = 2;
+
+    mutable QMutex mutex;
+    QWaitCondition ready;
+
+    int pending = 0;
+    bool stopped = false;
+
+    double emulated_rate = 60.0;
+    double period = 1000000.0 / 60.0;
+    double credit = 0.0;
+    double snapped = 1.0;
+
+    QElapsedTimer clock;
+    qint64 last = -1;
+
+    qint64 vsyncs = 0;
+    double interval_sum = 0.0;
+    double interval_squares = 0.0;
+    qint64 worst = 0;
+    qint64 missed = 0;
+    qint64 repeated = 0;
+    qint64 late = 0;
+
+
+public:
+    /*
+     *      Start pacing a game that runs at the given rate.
+     * */
+    void start(double emulated_rate)
+    {
+        QMutexLocker lk(&mutex);
+
+        this->emulated_rate = emulated_rate;
+        pending = 0;
+        stopped = false;
+        credit = 0.0;
+        snapped = 1.0;
+        clock.invalidate();
+        last = -1;
+
+        vsyncs = worst = missed = repeated = late = 0;
+        interval_sum = interval_squares = 0.0;
+    }
+
+
+    /*
+     *      Release the emulation thread for good.
+     * */
+    void stop()
+    {
+        QMutexLocker lk(&mutex);
+
+        stopped = true;
+        ready.wakeAll();
+    }
+
+
+    /*
+     *      Emulation thread: block until the next frame is due.
+     *      False once stopped.
+     * */
+    bool wait()
+    {
+        QMutexLocker lk(&mutex);
+
+        while(!pending && !stopped)
+            ready.wait(&mutex);
+
+        if(stopped)
+            return false;
+
+        pending--;
+        return true;
+    }
+
+
+    /*
+     *      Video thread: a frame has just been shown.
+     * */
+    void vsync()
+    {
+        QMutexLocker lk(&mutex);
+
+        if(!clock.isValid())
+            clock.start();
+
+        const qint64 now = clock.nsecsElapsed() / 1000;
+
+        // How many refreshes this vsync stands for; a missed one still earns its frames.
+        int elapsed = 1;
+
+        if(last >= 0)
+        {
+            const qint64 interval = now - last;
+
+            if(interval > 4 * period)
+                credit = 0.0;
+            else
+            {
+                period += (interval - period) / 32.0;
+
+                vsyncs++;
+                interval_sum += interval;
+                interval_squares += (double)interval * interval;
+                worst = qMax(worst, (qint64)std::fabs(interval - period));
+
+                if(interval > 1.5 * period)
+                    missed++;
+
+                elapsed = qMax(1, qRound(interval / period));
+            }
+        }
+
+        last = now;
+
+        const double ratio = emulated_rate * period / 1000000.0;
+        snapped = std::fabs(ratio - 1.0) < 0.01 ? ratio : 1.0;
+        credit += elapsed * (snapped != 1.0 ? 1.0 : ratio);
+
+        const int frames = (int)credit;
+        credit -= frames;
+
+        if(!frames)
+            repeated++;
+
+        pending += frames;
+
+        if(pending > MAX_PENDING)
+        {
+            late += pending - MAX_PENDING;
+            pending = MAX_PENDING;
+        }
+
+        if(pending)
+            ready.wakeOne();
+    }
+
+
+    /*
+     *      Emulated over displayed rate while the two are treated as
+     *      equal, 1 otherwise: each frame's sound times this is what
+     *      the display's clock leaves room for.
+     * */
+    double audioRatio() const
+    {
+        QMutexLocker lk(&mutex);
+
+        return snapped;
+    }
+
+
+    //
+    //
+    Stats stats() const
+    {
+        QMutexLocker lk(&mutex);
+
+        const double mean = vsyncs ? interval_sum / vsyncs : 0.0;
+        const double variance = vsyncs ? interval_squares / vsyncs - mean * mean : 0.0;
+
+        Stats stats;
+        stats.refresh  = 1000000.0 / period;
+        stats.vsyncs   = vsyncs;
+        stats.interval = (qint64)mean;
+        stats.jitter   = (qint64)std::sqrt(qMax(0.0, variance));
+        stats.worst    = worst;
+        stats.missed   = missed;
+        stats.repeated = repeated;
+        stats.late     = late;
+
+        return stats;
+    }
+};
@@ -0,0 +1,248 @@
+/*
+ * FramePipeline.hpp
+ *
+ *  Created on: Oct 19, 2026
+ *      Author: swatson
+ */
+
+#pragma once
+
+#include <shared.h>
+
+
+#include <vector>
+#include <cstring>
+#include <cstdint>
+
+
+#include <QMutex>
+#include <QElapsedTimer>
+
+
+/*
+ * Hands finished frames from the emulation thread to the video thread.
+ *
+ * By default the core draws straight into the presenter's buffer
+ * while the video thread posts that same buffer, so a post can show
+ * half of the next frame. A game with settings.threadedRender draws
+ * into one of BUFFERS buffers of its own instead:
+ *
+ *     draw()     emulation thread, before a frame: a buffer neither
+ *                the video thread nor anyone between frames reads
+ *     finish()   emulation thread, after it: the frame is the latest
+ *     present()  video thread: copy the latest frame into the
+ *                presenter's buffer, off the emulation thread
+ *
+ * With three buffers neither side ever waits for the other: the core
+ * goes on with the next frame on its core while the last one is
+ * copied and posted on the other. A frame the video thread didn't get
+ * to before the next one finished is dropped, and counted.
+ *
+ * Between frames bitmap.data is the latest frame, so screenshots and
+ * snapshots, taken on the emulation thread, read a whole frame as
+ * before. Other threads read it with readLatest(), under the lock. Only
+ * the viewport is copied, so the presenter's buffer ends up the same
+ * as when the core draws into it directly; HeadlessRunner's replays
+ * check that against the recorded hashes.
+ *
+ * Despite the setting's name this doesn't thread rendering: the
+ * core's VDP renders each line from its own globals in genlib, so all
+ * of it stays on the emulation thread. What moves is the copy and
+ * post after the frame, at the cost of BUFFERS more screen buffers
+ * and the copy itself.
+ *
+ * An interlaced frame only draws every other line, the field before
+ * it left the rest, so while the VDP is interlacing draw() starts the
+ * buffer from the latest frame.
+ * */
+class FramePipeline
+{
+public:
+    struct Stats
+    {
+        qint64 frames;      // finished by the core
+        qint64 presented;   // copied for the video thread
+        qint64 dropped;     // replaced before they were presented
+        qint64 copy;        // mean time to present one (us)
+        qint64 worst_copy;  // us
+    };
+
+
+private:
+    static constexpr auto BUFFERS = 3;
+
+    struct Viewport
+    {
+        int x, y, w, h;
+    };
+
+
+    QMutex mutex;
+    std::vector<uint8_t> buffers[BUFFERS];
+    Viewport viewports[BUFFERS];
+    int pitch = 0;
+
+    int drawing = 0;   // the core's
+    int latest = 0;    // what bitmap.data shows between frames
+    int pending = -1;  // finished and not yet presented
+    int copying = -1;  // being presented
+
+    QElapsedTimer clock;
+    Stats counts = Stats();
+    qint64 copy_sum = 0;
+
+
+public:
+    /*
+     *      Start every buffer from the frame the presenter shows.
+     * */
+    void open(const uint8_t *frame, int pitch, int height)
+    {
+        QMutexLocker lk(&mutex);
+
+        this->pitch = pitch;
+
+        for(int i = 0; i < BUFFERS; i++)
+        {
+            buffers[i].assign(frame, frame + pitch * height);
+            viewports[i] = { bitmap.viewport.x, bitmap.viewport.y, bitmap.viewport.w, bitmap.viewport.h };
+        }
+
+        drawing = latest = 0;
+        pending = copying = -1;
+        counts = Stats();
+        copy_sum = 0;
+
+        clock.start();
+    }
+
+
+    /*
+     *      Both threads must be parked.
+     * */
+    void close()
+    {
+        QMutexLocker lk(&mutex);
+
+        for(int i = 0; i < BUFFERS; i++)
+            std::vector<uint8_t>().swap(buffers[i]);
+    }
+
+
+    bool isOpen() const { return !buffers[0].empty(); }
+
+    /* Bytes held by the buffers, none while closed. */
+    size_t size() const { return buffers[0].size() * BUFFERS; }
+
+    uint8_t *current() { return buffers[latest].data(); }
+
+
+    //
+    //
+    uint8_t *draw()
+    {
+        QMutexLocker lk(&mutex);
+
+        for(drawing = 0; drawing == latest || drawing == pending || drawing == copying; drawing++);
+
+        uint8_t *frame = buffers[drawing].data();
+        const uint8_t *last = buffers[latest].data();
+
+        lk.unlock();
+
+        // The video thread only ever reads the latest frame.
+        if(interlaced)
+            memcpy( frame, last, buffers[0].size() );
+
+        return frame;
+    }
+
+
+    /*
+     *      Call read(frame, pitch, width, height) with the latest
+     *      finished frame's viewport. The core never draws into the
+     *      latest frame and can't finish another while read runs.
+     *      False when the pipeline isn't open.
+     * */
+    template<typename Reader>
+    bool readLatest(Reader read)
+    {
+        QMutexLocker lk(&mutex);
+
+        if(!isOpen())
+            return false;
+
+        const Viewport &view = viewports[latest];
+        read( buffers[latest].data() + view.y * pitch + view.x * sizeof(uint16_t), pitch, view.w, view.h );
+
+        return true;
+    }
+
+
+    //
+    //
+    void finish()
+    {
+        QMutexLocker lk(&mutex);
+
+        viewports[drawing] = { bitmap.viewport.x, bitmap.viewport.y, bitmap.viewport.w, bitmap.viewport.h };
+
+        if(pending >= 0)
+            counts.dropped++;
+
+        pending = latest = drawing;
+        counts.frames++;
+    }
+
+
+    /*
+     *      Copy the latest frame, if there is a new one, into target.
+     * */
+    bool present(uint8_t *target)
+    {
+        QMutexLocker lk(&mutex);
+
+        if(pending < 0)
+            return false;
+
+        copying = pending;
+        pending = -1;
+
+        const Viewport view = viewports[copying];
+        const uint8_t *frame = buffers[copying].data();
+        const qint64 start = clock.nsecsElapsed();
+
+        lk.unlock();
+
+        for(int y = view.y; y < view.y + view.h; y++)
+            memcpy( target + y * pitch + view.x * sizeof(uint16_t), frame + y * pitch + view.x * sizeof(uint16_t), view.w * sizeof(uint16_t) );
+
+        lk.relock();
+
+        const qint64 cost = (clock.nsecsElapsed() - start) / 1000;
+
+        copying = -1;
+        counts.presented++;
+        copy_sum += cost;
+        counts.worst_copy = qMax(counts.worst_copy, cost);
+
+        return true;
+    }
+
+
+    /*
+     *      Since the last call.
+     * */
+    Stats take()
+    {
+        QMutexLocker lk(&mutex);
+
+        Stats stats = counts;
+        stats.copy = counts.presented ? copy_sum / counts.presented : 0;
+
+        counts = Stats();
+        copy_sum = 0;
+
+        return stats;
+    }
+};
@@ -8,18 +8,24 @@
 #pragma once
 
 #include "GenesisViewUI.hpp"
-
-
-#include <cerrno>
+#include "ImportPipeline.hpp"
+#include "LibraryDataModel.hpp"
+#include "StateListModel.hpp"
+#include "TitleIndex.hpp"
 
 
 #include <fstream>
-#include <numeric>
 #include <iterator>
 #include <algorithm>
 
 
+#include <QSet>
+#include <QHash>
+#include <QTimer>
 #include <QObject>
+#include <QDateTime>
+#include <QFutureWatcher>
+#include <QtConcurrentRun>
 
 
 // Data Sources
@@ -103,7 +109,6 @@ using namespace bb::cascades::pickers;
 using namespace bb::system;
 using namespace bb::cascades;
 
-// TODO Add cancel button during box art download.
 // TODO Add save state support.
 // TODO Add settings screen. Image at top.
 /*
@@ -125,7 +130,13 @@ using namespace bb::cascades;
  *              "gameId_0.gp0",
  *              "gameId_0.gp0",
  *              ...
- *         ]
+ *         ],
+ *         "resume": "gameId.resume",
+ *         "patches": [
+ *              "translation.bps",
+ *              ...
+ *         ],
+ *         "patchedCRC": "1A2B3C4D"
  *     },
  *     ...
  * ]
@@ -134,15 +145,29 @@ using namespace bb::cascades;
  * title: a string that contain the game's title.
  * settings: a map that contain the game's custom settings.
  * states: an array of strings that contain game's path to the saved state file from the cwd.
+ * resume: a string, the state the game was closed in. Restored when it's opened again.
+ * patches: an array of IPS or BPS files in data/patches/<gameID>, applied in
+ *          order when the game is loaded (see RomPatcher).
+ * patchedCRC: a string, optional, the CRC the patched ROM must have.
  *
  * settings:
- *     spec TBD
+ *     title: a bool, show the title over the box art.
+ *     livePreview: a bool, keep the game running in the active
+ *                  frame while minimized instead of pausing.
+ *     hibernateAfter: an int, seconds paused in the background before
+ *                     the game's memory is given back. 0 never does.
+ *     audioFilter: a map, post-processing of the game's sound (see
+ *                  AudioFilter). volume 0-1, lowPass 0-1, width 0-2
+ *                  and dcBlock. Left out, the sound is untouched.
+ *     threadedRender: a bool, hand each finished frame to the video
+ *                     thread instead of sharing one buffer with it
+ *                     (see FramePipeline).
  *
  * states:
  *     Saved states are put in the data folder and, given
- *     the extension gp0. All saved states have a corresponding
- *     image associated with them. The image has the same file
- *     name as the saved state file but, with the extension bmp.
+ *     the extension gp0. Each one is a Snapshot whose header
+ *     holds its time, play time and a small thumbnail, so the
+ *     list can be drawn without touching the state itself.
  * */
 class GameLibraryUI: public QObject
 {
@@ -150,7 +175,19 @@ class GameLibraryUI: public QObject
 
     GenesisViewUI genesis_view_ui;
 
-    ArrayDataModel *data_model = new ArrayDataModel( this );
+    LibraryDataModel *data_model = new LibraryDataModel( this );
+
+    /*
+     *      Title search. Results are shown through a filter
+     *      model in place of the library in the same grid.
+     * */
+    TitleIndex title_index;
+    LibraryFilterModel *search_model = new LibraryFilterModel( data_model, this );
+    ListView *game_list_view = nullptr;
+    TextField *search_field = TextField::create().parent( this )
+                                                 .hintText( "Search" )
+                                                 .horizontal( HorizontalAlignment::Fill )
+                                                 .connect( SIGNAL(textChanging(const QString&)), this, SLOT(onSearchChanging(const QString&)) );
 
     Page *game_library_view = new Page( this );
     Page *saved_state_view = new Page( this );
@@ -182,11 +219,15 @@ class GameLibraryUI: public QObject
     };
     OptionForm *option_sheet = new OptionForm(this);
     FilePicker *boxart_picker = new FilePicker(this);
+    FilePicker *patch_picker = new FilePicker(this);
     SystemPrompt *rename_prompt = new SystemPrompt(this);
     SystemDialog *delete_dialog = new SystemDialog("Delete", "Cancel", this);
     FilePicker *import_picker = new FilePicker(this);
-    QPointer<QFutureWatcher<void>> import_watcher;
-    QMutex import_watcher_mutex;
+    FilePicker *import_folder_picker = new FilePicker(this);
+    QPointer<ImportPipeline> import_pipeline;
+    SystemProgressToast *import_toast = new SystemProgressToast(this);
+    QSet<int> import_placeholders;
+    QTimer *save_timer = new QTimer(this);
 
     /*
      *      Create a segmented title bar for UI.
@@ -215,27 +256,117 @@ class GameLibraryUI: public QObject
 
     Q_SLOT void loadDataBase()
     {
-        JsonDataAccess jda;
+        data_model->load("data/library.json");
+    }
 
-        const auto &data = jda.load("data/library.json");
 
-        if( !jda.hasError() )
-            data_model->append( data.toList() );
+    Q_SLOT void saveDataBase()
+    {
+        data_model->flush();
+        data_model->save("data/library.json");
     }
 
 
-    Q_SLOT void saveDataBase()
+#ifdef MARKV_TRACE
+    /*
+     *      Write out the trace spans for a bug report.
+     * */
+    Q_SLOT void saveTrace()
+    {
+        const QString &file = "/accounts/1000/shared/documents/Mark_V-trace-" + QDateTime::currentDateTime().toString("yyyyMMdd-hhmmss") + ".json";
+
+        SystemToast *toast = new SystemToast(this);
+        toast->setBody( Trace::dump(file) ? "Trace saved to " + file : "Could not save the trace" );
+        toast->show();
+
+        bool connection;
+        connection = connect( toast, SIGNAL(finished(bb::system::SystemUiResult::Type)), toast, SLOT(deleteLater()) );
+        Q_ASSERT( connection );
+        Q_UNUSED( connection );
+    }
+#endif
+
+
+    /*
+     *      Alternate names for every ROM CRC in the catalog.
+     * */
+    static QHash<QString, QStringList> loadAlternateNames()
     {
         JsonDataAccess jda;
+        QHash<QString, QStringList> names;
 
-        QVariantList data;
-        for(int i = 0; i < data_model->size(); i++)
-            if( data_model->value(i).toMap().isEmpty() )
-                continue;
-            else
-                data << data_model->value(i);
+        for( const auto &entry : jda.load("app/native/assets/games.json").toList() )
+        {
+            const QString &crc = entry.toMap().value("romHashCRC").toString();
+            const QString &name = entry.toMap().value("releaseTitleName").toString();
+
+            if( !names.value(crc).contains(name) )
+                names[crc] << name;
+        }
 
-        jda.save(data, "data/library.json");
+        return names;
+    }
+
+
+    Q_SLOT void buildTitleIndex()
+    {
+        auto *watcher = new QFutureWatcher<QHash<QString, QStringList>>( this );
+        watcher->connect( watcher, SIGNAL( finished() ), this, SLOT( onAlternateNamesLoaded() ) );
+        watcher->setFuture( QtConcurrent::run( &GameLibraryUI::loadAlternateNames ) );
+    }
+
+
+    Q_SLOT void onAlternateNamesLoaded()
+    {
+        auto *watcher = static_cast<QFutureWatcher<QHash<QString, QStringList>>*>( sender() );
+
+        title_index.clear();
+        title_index.setAlternates( watcher->result() );
+        watcher->deleteLater();
+
+        for( int i = 0; i < data_model->size(); i++ )
+            title_index.update( data_model->gameID(i), data_model->peek(i, "title") );
+
+        refreshSearch();
+    }
+
+
+    Q_INVOKABLE void indexGame(const QString &gameID, const QString &title)
+    {
+        title_index.update( gameID, title );
+    }
+
+
+    Q_SLOT void onSearchChanging(const QString &text)
+    {
+        if( text.trimmed().isEmpty() )
+        {
+            if( game_list_view->dataModel() != data_model )
+                game_list_view->setDataModel( data_model );
+
+            return;
+        }
+
+        QList<int> rows;
+        for( const auto &id : title_index.query(text) )
+        {
+            const int row = data_model->indexOf(id);
+
+            if( row >= 0 )
+                rows << row;
+        }
+
+        search_model->setRows( rows );
+
+        if( game_list_view->dataModel() != search_model )
+            game_list_view->setDataModel( search_model );
+    }
+
+
+    Q_SLOT void refreshSearch()
+    {
+        if( game_list_view && !search_field->text().trimmed().isEmpty() )
+            onSearchChanging( search_field->text() );
     }
 
 
@@ -297,8 +428,22 @@ class GameLibraryUI: public QObject
 
     Q_SLOT void onLibraryListTriggered(QVariantList indexPath)
     {
-        if(!genesis_view_ui.isRunning() && !data_model->data(indexPath).toMap().isEmpty())
-            genesis_view_ui.openROM( data_model->data(indexPath).toMap() );
+        const auto &game = game_list_view->dataModel()->data(indexPath).toMap();
+
+        if(!genesis_view_ui.isRunning() && !game.isEmpty())
+            genesis_view_ui.openROM( game );
+    }
+
+
+    /*
+     *      Play a game from the start instead of its resume state.
+     * */
+    Q_SLOT void restartGame(int index)
+    {
+        const auto &game = data_model->value(index).toMap();
+
+        if(!genesis_view_ui.isRunning() && !game.isEmpty())
+            genesis_view_ui.openROM( game, true );
     }
 
 
@@ -308,6 +453,145 @@ class GameLibraryUI: public QObject
     }
 
 
+    /*
+     *      A state in one of the saved states rows. The row's
+     *      ListView carries the library row it was made for.
+     * */
+    Q_SLOT void onStateTriggered(QVariantList indexPath)
+    {
+        auto *list = qobject_cast<ListView*>( sender() );
+        const auto &game = data_model->value( list->property("row").toInt() ).toMap();
+        const auto &state = list->dataModel()->data(indexPath).toMap();
+
+        if(genesis_view_ui.isRunning() || game.isEmpty())
+            return;
+
+        // Opening a game restores its resume state by itself.
+        genesis_view_ui.openROM( game );
+
+        if(!state.value("resume").toBool())
+            genesis_view_ui.loadState( "data/" + state.value("file").toString() );
+    }
+
+
+    /*
+     *      Delete a state from a saved states row, resume included.
+     * */
+    Q_SLOT void onStateDeleteTriggered()
+    {
+        auto *list = qobject_cast<ListView*>( sender()->parent() );
+        const auto &game = data_model->value( list->property("row").toInt() ).toMap();
+        const auto &state = list->dataModel()->data( list->selected() ).toMap();
+
+        if(game.isEmpty() || state.isEmpty())
+            return;
+
+        // The running game may be about to replace its resume state.
+        if(genesis_view_ui.isRunning())
+            return;
+
+        deleteState( game.value("gameID").toString(), state.value("file").toString() );
+    }
+
+
+    //
+    //
+    void deleteState(const QString &gameID, const QString &name)
+    {
+        qDebug() << QFile::remove( "data/" + name );
+
+        data_model->postEdit( gameID, [name](QVariantMap &entry) {
+            QVariantList states = entry.value("states").toList();
+            states.removeAll(name);
+            entry["states"] = states;
+
+            if(entry.value("resume").toString() == name)
+                entry.remove("resume");
+        } );
+
+        collectChunks(gameID);
+        save_timer->start();
+    }
+
+
+    /*
+     *      Drop the chunks none of a game's snapshots use any more,
+     *      e.g. those of the resume state a suspend just replaced or
+     *      of a state just deleted. The snapshot just written may not
+     *      be in the entry yet; a deleted one is gone from disk, so
+     *      it has no manifest to keep its chunks whether or not the
+     *      entry still lists it.
+     * */
+    void collectChunks(const QString &gameID, const QString &written = QString())
+    {
+        const auto &game = data_model->value( data_model->indexOf(gameID) ).toMap();
+
+        QStringList files;
+
+        if(!written.isEmpty())
+            files << "data/" + written;
+
+        if(game.contains("resume"))
+            files << "data/" + game.value("resume").toString();
+
+        for(const auto &state : game.value("states").toList())
+            files << "data/" + state.toString();
+
+        files.removeDuplicates();
+
+        // Reading the manifests and collecting both happen on the pool.
+        QtConcurrent::run( [gameID, files]() {
+            QList<QList<QByteArray>> manifests;
+
+            for(const auto &file : files)
+                manifests << Snapshot::manifest(file);
+
+            ChunkStore::collect( Snapshot::chunks(gameID), manifests );
+        } );
+    }
+
+
+    Q_SLOT void onStateSaved(const QString &gameID, const QString &file)
+    {
+        const QString &name = QFileInfo(file).fileName();
+
+        data_model->postEdit( gameID, [name](QVariantMap &entry) {
+            QVariantList states = entry.value("states").toList();
+            states << name;
+            entry["states"] = states;
+        } );
+
+        collectChunks(gameID, name);
+        save_timer->start();
+    }
+
+
+    Q_SLOT void onRecordingSaved(const QString &file)
+    {
+        SystemToast *toast = new SystemToast(this);
+        toast->setBody( "Recording saved to " + file );
+        toast->show();
+
+        bool connection;
+        connection = connect( toast, SIGNAL(finished(bb::system::SystemUiResult::Type)), toast, SLOT(deleteLater()) );
+        Q_ASSERT( connection );
+        Q_UNUSED( connection );
+    }
+
+
+    Q_SLOT void onSuspended(const QString &gameID, const QString &file)
+    {
+        const QString &name = QFileInfo(file).fileName();
+
+        data_model->postEdit( gameID, [name](QVariantMap &entry) {
+            entry["resume"] = name;
+        } );
+
+        collectChunks(gameID, name);
+        save_timer->start();
+    }
+
+
     Q_SLOT void showRenameGamePrompt(int index)
     {
         QSignalMapper *rename_signal_remap = new QSignalMapper(this);
@@ -336,6 +620,9 @@ class GameLibraryUI: public QObject
 
             data_model->replace(index, entry);
             saveDataBase();
+
+            indexGame( entry.value("gameID").toString(), entry.value("title").toString() );
+            refreshSearch();
         }
     }
 
@@ -372,8 +659,21 @@ class GameLibraryUI: public QObject
                 qDebug() << QFile::remove( "data/" + state.toString() );
             }
 
+            if( data_model->value(index).toMap().contains( "resume" ) )
+            {
+                qDebug() << QFile::remove( "data/" + data_model->value(index).toMap().value( "resume" ).toString() );
+            }
+
+            RomPatcher::forget( data_model->gameID(index) );
+
+            // With every state gone none of the game's chunks are needed.
+            QtConcurrent::run( &ChunkStore::collect, Snapshot::chunks( data_model->gameID(index) ), QList<QList<QByteArray>>() );
+
+            title_index.remove( data_model->gameID(index) );
+
             data_model->removeAt(index);
             saveDataBase();
+            refreshSearch();
         }
     }
 
@@ -414,6 +714,74 @@ class GameLibraryUI: public QObject
     }
 
 
+    Q_SLOT void showSetPatchesPrompt(int index)
+    {
+        QSignalMapper *patch_signal_remap = new QSignalMapper(this);
+        patch_signal_remap->setMapping(patch_picker, index);
+
+        bool connection;
+        Q_UNUSED( connection );
+        connection = connect( patch_signal_remap, SIGNAL(mapped(int)), this, SLOT(setPatches(int)) );
+        Q_ASSERT( connection );
+        connection = connect( patch_picker, SIGNAL(fileSelected(const QStringList&)), patch_signal_remap, SLOT(map()) );
+        Q_ASSERT( connection );
+        connection = connect( patch_picker, SIGNAL(fileSelected(const QStringList&)), patch_signal_remap, SLOT(deleteLater()) );
+        Q_ASSERT( connection );
+        connection = connect( patch_picker, SIGNAL(canceled()), patch_signal_remap, SLOT(deleteLater()) );
+        Q_ASSERT( connection );
+
+        patch_picker->open();
+    }
+
+
+    /*
+     *      The picked patches replace the game's, in the order picked.
+     *      They are copied into data/patches/<gameID> and applied at
+     *      load. patchedCRC is kept while the patches are the same.
+     * */
+    Q_SLOT void setPatches(int index)
+    {
+        const QString &gameID = data_model->gameID(index);
+        QStringList names;
+        QDir().mkpath( RomPatcher::patchDir(gameID) );
+
+        for( const auto &file : patch_picker->selectedFiles() )
+        {
+            const QString &name = QFileInfo(file).fileName();
+
+            QFile::remove( RomPatcher::patchFile(gameID, name) );
+            if( QFile::copy( file, RomPatcher::patchFile(gameID, name) ) )
+                names << name;
+        }
+
+        RomPatcher::prune( gameID, names );
+
+        data_model->postEdit( gameID, [names](QVariantMap &entry) {
+            if( entry.value("patches").toStringList() != names )
+                entry.remove("patchedCRC");
+
+            entry["patches"] = QVariant(names).toList();
+        } );
+
+        save_timer->start();
+    }
+
+
+    //
+    //
+    Q_SLOT void clearPatches(int index)
+    {
+        RomPatcher::forget( data_model->gameID(index) );
+
+        data_model->postEdit( data_model->gameID(index), [](QVariantMap &entry) {
+            entry.remove("patches");
+            entry.remove("patchedCRC");
+        } );
+
+        save_timer->start();
+    }
+
+
     Q_SLOT void showGameOptionPrompt(int index)
     {
         QSignalMapper *option_signal_remap = new QSignalMapper(this);
@@ -449,115 +817,118 @@ class GameLibraryUI: public QObject
 
     Q_SLOT void importGames(const QStringList& selectedFiles)
     {
-        struct ProccessFile
-        {
-            QAtomicPointer<GameLibraryUI> instance;
+        if( !import_pipeline.isNull() )
+            return;
+
+        import_pipeline = new ImportPipeline( selectedFiles, this );
 
-            ProccessFile(GameLibraryUI *caller): instance(caller) {}
+        bool connection;
+        Q_UNUSED( connection );
+        connection = connect( import_pipeline, SIGNAL(queued(int)), this, SLOT(onImportQueued(int)) );
+        Q_ASSERT( connection );
+        connection = connect( import_pipeline, SIGNAL(dropped(int)), this, SLOT(onImportDropped(int)) );
+        Q_ASSERT( connection );
+        connection = connect( import_pipeline, SIGNAL(persisted(int, const QVariantMap&)), this, SLOT(onImportPersisted(int, const QVariantMap&)) );
+        Q_ASSERT( connection );
+        connection = connect( import_pipeline, SIGNAL(artFetched(const QString&)), this, SLOT(onImportArtFetched(const QString&)) );
+        Q_ASSERT( connection );
+        connection = connect( import_pipeline, SIGNAL(progress(int, int)), this, SLOT(onImportProgress(int, int)) );
+        Q_ASSERT( connection );
+        connection = connect( import_pipeline, SIGNAL(finished(bool)), this, SLOT(onImportFinished(bool)) );
+        Q_ASSERT( connection );
 
+        import_toast->setBody( "Importing" );
+        import_toast->setProgress( 0 );
+        import_toast->setState( SystemUiProgressState::Active );
+        import_toast->setPosition( SystemUiPosition::BottomCenter );
+        import_toast->button()->setLabel( "Cancel" );
+        import_toast->show();
 
-            void operator()(const QString &filePath)
-             {
-                std::ifstream rom_file( filePath.toAscii().constData(), std::ifstream::binary | std::ifstream::in );
+        import_pipeline->start();
+    }
 
-                if( rom_file.is_open() )
-                {
-                    int at = instance->data_model->size();
-                    instance->data_model->append( QVariantMap() );
 
-                    // Calculate CRC
-                    const auto &crc_string = QString::number( std::accumulate( std::istreambuf_iterator<char>(rom_file),
-                                                                               std::istreambuf_iterator<char>(),
-                                                                               crc32(0L, Z_NULL, 0),
-                                                                               [](uLong crc, Bytef byte) {
-                                                                                   return crc32( crc, &byte, sizeof(char) );
-                                                                               } ), 16 ).toUpper();
+    /*
+     *      Import placeholders are posted to the model under the
+     *      job's id + 1 and applied with the next batch.
+     * */
+    Q_SLOT void onImportQueued(int job)
+    {
+        import_placeholders.insert(job);
+        data_model->postAppend( job + 1, QVariantMap() );
+    }
 
 
-                    // Look for entry in database.
-                    const auto rbegin = std::reverse_iterator<QList<QVariant>::const_iterator>( instance->import_watcher->property("db").toList().constEnd() );
-                    const auto rend   = std::reverse_iterator<QList<QVariant>::const_iterator>( instance->import_watcher->property("db").toList().constBegin() );
+    Q_SLOT void onImportDropped(int job)
+    {
+        if( import_placeholders.remove(job) )
+            data_model->postRemove( job + 1 );
+    }
 
-                    auto found = std::find_if( rbegin, rend,
-                                               [crc_string](const QVariant &entry) {
-                                                   return entry.toMap().value("romHashCRC") == crc_string;
-                                               } );
 
-                    const auto &found_entry = (found != rend) ? found->toMap() : QVariantMap();
+    Q_SLOT void onImportPersisted(int job, const QVariantMap &entry)
+    {
+        if( !import_placeholders.remove(job) )
+            return;
 
+        data_model->postReplace( job + 1, entry );
+        indexGame( entry.value("gameID").toString(), entry.value("title").toString() );
+        save_timer->start();
+    }
 
-                    if( instance->import_watcher->isCanceled() )
-                        return instance->data_model->removeAt(at);
 
-                    // Download cover art if any.
-                    if( found_entry.contains("releaseCoverFront") && !QFileInfo("data/" + crc_string + ".img").exists() )
-                    {
-                        QScopedPointer<QNetworkAccessManager> manager( new QNetworkAccessManager );
-                        QScopedPointer<QNetworkReply> reply( manager->get( QNetworkRequest( found_entry.value("releaseCoverFront").toUrl() ) ) );
-
-                        QEventLoop loop;
-                        loop.connect( instance->import_watcher, SIGNAL(canceled()), SLOT(quit()) );
-                        loop.connect( reply.data(), SIGNAL(finished()), SLOT(quit()) );
-                        loop.exec();
-
-                        if( !reply->isFinished() )
-                            return instance->data_model->removeAt(at);
-
-                        if( reply->error() == QNetworkReply::NoError )
-                        {
-                            QImage img;
-                            img.loadFromData( reply->readAll() );
-                            img.scaledToWidth(100, Qt::SmoothTransformation).save( "data/" + crc_string + ".img", "png" );
-                        }
-                    }
+    Q_SLOT void onImportArtFetched(const QString &gameID)
+    {
+        data_model->postEdit( gameID, [](QVariantMap &entry) {
+            QVariantMap settings = entry.value("settings").toMap();
+            settings["title"] = false;
+            entry["settings"] = settings;
+        } );
 
+        save_timer->start();
+    }
 
-                    // Copy or Move File
-                    rom_file.seekg(0, std::ios_base::beg);
-                    std::ofstream dst_file( ("data/" + crc_string + ".bin").toAscii().constData(), std::ifstream::binary | std::ifstream::out );
-                    std::copy( std::istreambuf_iterator<char>(rom_file),
-                               std::istreambuf_iterator<char>(),
-                               std::ostreambuf_iterator<char>(dst_file) );
-                    dst_file.flush();
 
+    /*
+     *      total is 0 while files are still being found.
+     * */
+    Q_SLOT void onImportProgress(int done, int total)
+    {
+        if( !total )
+        {
+            import_toast->setBody( QString("Imported %1").arg(done) );
+            import_toast->setProgress( -1 );
+            return;
+        }
 
-                    // Add to database.
-                    QVariantMap settings;
-                    settings["title"] = !QFileInfo("data/" + crc_string + ".img").exists();
+        import_toast->setBody( QString("Imported %1 of %2").arg(done).arg(total) );
+        import_toast->setProgress( done * 100 / total );
+    }
 
-                    QVariantMap entry;
-                    entry["gameID"] = crc_string;
-                    entry["title"]  = found_entry.contains("releaseTitleName") ? found_entry.value("releaseTitleName").toString() : "";
-                    entry["settings"] = settings;
 
-                    instance->data_model->replace(at, entry);
+    Q_SLOT void onImportToastFinished(bb::system::SystemUiResult::Type result)
+    {
+        if( result == SystemUiResult::ButtonSelection && !import_pipeline.isNull() )
+            import_pipeline->cancel();
+    }
 
 
-                    QMutexLocker lk(&instance->import_watcher_mutex);
+    Q_SLOT void onImportFinished(bool canceled)
+    {
+        Q_UNUSED( canceled );
 
-                    JsonDataAccess jda;
-                    auto data = jda.load("data/library.json").toList();
-                    data.append(entry);
-                    jda.save(data, "data/library.json");
-                }
-                else
-                {
-                    if(errno == EACCES)
-                    {
-                        qErrnoWarning("proccessFile: ");
-                        qDebug() << "TODO - ask for permission.";
-                    }
-                }
-             }
-        };
+        // Placeholders for files that never made it through.
+        for( const int job : import_placeholders )
+            data_model->postRemove( job + 1 );
 
+        import_placeholders.clear();
 
-        JsonDataAccess jda;
+        save_timer->stop();
+        saveDataBase();
 
-        import_watcher = new QFutureWatcher<void>(this);
-        import_watcher->connect( import_watcher.data(), SIGNAL( finished() ), SLOT( deleteLater() ) );
-        import_watcher->setProperty( "db", jda.load("app/native/assets/games.json") );
-        import_watcher->setFuture( QtConcurrent::map( selectedFiles, ProccessFile(this) ) );
+        import_toast->setState( SystemUiProgressState::Inactive );
+        import_toast->cancel();
+        import_pipeline->deleteLater();
     }
 
 
@@ -585,7 +956,10 @@ class GameLibraryUI: public QObject
 
             QSignalMapper *rename_signal_map = new QSignalMapper(this);
             QSignalMapper *boxart_signal_map = new QSignalMapper(this);
+            QSignalMapper *patch_signal_map = new QSignalMapper(this);
+            QSignalMapper *clear_patch_signal_map = new QSignalMapper(this);
             QSignalMapper *option_signal_map = new QSignalMapper(this);
+            QSignalMapper *restart_signal_map = new QSignalMapper(this);
             QSignalMapper *delete_signal_map = new QSignalMapper(this);
 
             VisualNode *createItem( ListView *list, const QString &type ) override
@@ -619,7 +993,10 @@ class GameLibraryUI: public QObject
                                                    .actionSet( ActionSet::create().parent( list )
                                                                                   .add( ActionItem::create().parent( list ).title( "Rename" ).imageSource( QUrl("asset:///ic_rename.png") ).onTriggered( rename_signal_map, SLOT(map()) ) )
                                                                                   .add( ActionItem::create().parent( list ).title( "Set Image" ).imageSource( QUrl("asset:///ic_view_image.png") ).onTriggered( boxart_signal_map, SLOT(map()) ) )
+                                                                                  .add( ActionItem::create().parent( list ).title( "Patches" ).onTriggered( patch_signal_map, SLOT(map()) ) )
+                                                                                  .add( ActionItem::create().parent( list ).title( "Clear Patches" ).onTriggered( clear_patch_signal_map, SLOT(map()) ) )
                                                                                   .add( ActionItem::create().parent( list ).title( "Settings" ).onTriggered( option_signal_map, SLOT(map()) ) )
+                                                                                  .add( ActionItem::create().parent( list ).title( "Restart" ).onTriggered( restart_signal_map, SLOT(map()) ) )
                                                                                   .add( DeleteActionItem::create().parent( list ).onTriggered( delete_signal_map, SLOT(map()) ) ) );
                 }
                 else
@@ -634,7 +1011,7 @@ class GameLibraryUI: public QObject
                 }
             }
 
-            void updateItem( ListView           *list      __attribute__((unused)),
+            void updateItem( ListView           *list,
                              VisualNode         *listItem,
                              const QString      &type,
                              const QVariantList &indexPath,
@@ -652,8 +1029,16 @@ class GameLibraryUI: public QObject
                         return Image( image_file.readAll() );
                     };
 
+                    // Only reload the box art if this cell shows a different image now.
+                    const QFileInfo image_info( "data/" + data.toMap().value( "gameID" ).toString() + ".img" );
+                    const QString image_key = image_info.exists() ? image_info.filePath() + "@" + QString::number( image_info.lastModified().toMSecsSinceEpoch() ) : QString();
+
                     auto *image_view = qobject_cast<ImageView*>( content->at(0) );
-                    image_view->setImage( QFileInfo( "data/" + data.toMap().value( "gameID" ).toString() + ".img" ).exists() ? load_boxart() : nobox_icon );
+                    if( !image_view->property("boxart").isValid() || image_view->property("boxart").toString() != image_key )
+                    {
+                        image_view->setImage( image_info.exists() ? load_boxart() : nobox_icon );
+                        image_view->setProperty( "boxart", image_key );
+                    }
 
                     // Add the title.
                     qobject_cast<Container*>( content->at(1) )->setVisible( data.toMap().value("settings").toMap().value("title").toBool() );
@@ -663,11 +1048,18 @@ class GameLibraryUI: public QObject
                     // Add context menu title
                     list_item->actionSetAt(0)->setTitle( data.toMap().value( "title" ).toString() );
 
+                    // Search results map back to the library's rows.
+                    auto *filter = qobject_cast<LibraryFilterModel*>( list->dataModel() );
+                    const int index = filter ? filter->sourceRow( indexPath[0].toInt() ) : indexPath[0].toInt();
+
                     // Map Context Menu Signals
-                    rename_signal_map->setMapping( list_item->actionSetAt(0)->at(0), indexPath[0].toInt() ); //Rename
-                    boxart_signal_map->setMapping( list_item->actionSetAt(0)->at(1), indexPath[0].toInt() ); //Set Game Cover Art
-                    option_signal_map->setMapping( list_item->actionSetAt(0)->at(2), indexPath[0].toInt() ); //Settings
-                    delete_signal_map->setMapping( list_item->actionSetAt(0)->at(3), indexPath[0].toInt() ); //Delete
+                    rename_signal_map->setMapping( list_item->actionSetAt(0)->at(0), index ); //Rename
+                    boxart_signal_map->setMapping( list_item->actionSetAt(0)->at(1), index ); //Set Game Cover Art
+                    patch_signal_map->setMapping( list_item->actionSetAt(0)->at(2), index ); //Patches
+                    clear_patch_signal_map->setMapping( list_item->actionSetAt(0)->at(3), index ); //Clear Patches
+                    option_signal_map->setMapping( list_item->actionSetAt(0)->at(4), index ); //Settings
+                    restart_signal_map->setMapping( list_item->actionSetAt(0)->at(5), index ); //Restart
+                    delete_signal_map->setMapping( list_item->actionSetAt(0)->at(6), index ); //Delete
                 }
                 else
                 {
@@ -686,19 +1078,26 @@ class GameLibraryUI: public QObject
                 Q_ASSERT(connection);
                 connection = connect( boxart_signal_map, SIGNAL(mapped(int)), parent, SLOT(showSetGameArtPrompt(int)) );
                 Q_ASSERT(connection);
+                connection = connect( patch_signal_map, SIGNAL(mapped(int)), parent, SLOT(showSetPatchesPrompt(int)) );
+                Q_ASSERT(connection);
+                connection = connect( clear_patch_signal_map, SIGNAL(mapped(int)), parent, SLOT(clearPatches(int)) );
+                Q_ASSERT(connection);
                 connection = connect( option_signal_map, SIGNAL(mapped(int)), parent, SLOT(showGameOptionPrompt(int)) );
                 Q_ASSERT(connection);
+                connection = connect( restart_signal_map, SIGNAL(mapped(int)), parent, SLOT(restartGame(int)) );
+                Q_ASSERT(connection);
                 connection = connect( delete_signal_map, SIGNAL(mapped(int)), parent, SLOT(showDeleteGamePrompt(int)) );
                 Q_ASSERT(connection);
             }
         };
 
-        ListView *game_list_view = ListView::create().parent( game_library_view )
-                                                     .dataModel( data_model )
-                                                     .listItemProvider( new GameItemProvider( this ) )
-                                                     .layout( GridListLayout::create().orientation( LayoutOrientation::TopToBottom ).parent( game_library_view ) );
+        game_list_view = ListView::create().parent( game_library_view )
+                                           .dataModel( data_model )
+                                           .listItemProvider( new GameItemProvider( this ) )
+                                           .layout( GridListLayout::create().orientation( LayoutOrientation::TopToBottom ).parent( game_library_view ) );
         game_list_view->setListItemTypeMapper( new GameItemTypeMapper( game_list_view ) );
 
+        game_library_content->add( search_field );
         game_library_content->add( game_list_view );
         game_library_content->setTopPadding( game_library_content->ui()->du(0.5f) );
         game_library_content->setBottomPadding( game_library_content->ui()->du(0.5f) );
@@ -708,8 +1107,17 @@ class GameLibraryUI: public QObject
                                                           .title( "Import" )
                                                           .imageSource( QUrl("asset:///ic_add.png") )
                                                           .connect( SIGNAL( triggered() ), import_picker, SLOT( open() ) ), ActionBarPlacement::Signature );
+        game_library_view->addAction( ActionItem::create().parent( game_library_view )
+                                                          .title( "Import Folder" )
+                                                          .imageSource( QUrl("asset:///ic_add.png") )
+                                                          .connect( SIGNAL( triggered() ), import_folder_picker, SLOT( open() ) ), ActionBarPlacement::InOverflow );
         game_library_view->addAction( ActionItem::create().parent( game_library_view )
                                                           .title( "Play Game" ), ActionBarPlacement::InOverflow );
+#ifdef MARKV_TRACE
+        game_library_view->addAction( ActionItem::create().parent( game_library_view )
+                                                          .title( "Save Trace" )
+                                                          .connect( SIGNAL( triggered() ), this, SLOT( saveTrace() ) ), ActionBarPlacement::InOverflow );
+#endif
 
 
         /*
@@ -725,7 +1133,7 @@ class GameLibraryUI: public QObject
         {
             QString itemType( const QVariant& data, const QVariantList& indexPath __attribute__((unused)) ) override
             {
-                return data.toMap().contains( "states" ) ? "states" : "";
+                return data.toMap().contains( "states" ) || data.toMap().contains( "resume" ) ? "states" : "";
             }
 
         public:
@@ -742,15 +1150,51 @@ class GameLibraryUI: public QObject
             {
                 VisualNode *createItem( ListView *list, const QString &type __attribute__((unused)) ) override
                 {
-                    return ImageView::create("asset:///ic_noboxart.png").parent( list );
+                    Label *time_label = Label::create().parent( list )
+                                                       .horizontal( HorizontalAlignment::Center );
+                    time_label->textStyle()->setFontSize( FontSize::XSmall );
+
+                    return Container::create().parent( list )
+                                              .layout( DockLayout::create().parent( list ) )
+                                              .add( ImageView::create("asset:///ic_noboxart.png").parent( list )
+                                                                                                 .vertical( VerticalAlignment::Fill )
+                                                                                                 .horizontal( HorizontalAlignment::Fill )
+                                                                                                 .scalingMethod( ScalingMethod::AspectFit ) )
+                                              .add( Container::create().parent( list )
+                                                                       .background( list->ui()->palette()->background() )
+                                                                       .opacity( 0.75f )
+                                                                       .vertical( VerticalAlignment::Bottom )
+                                                                       .horizontal( HorizontalAlignment::Fill )
+                                                                       .add( time_label ) );
                 }
 
                 void updateItem( ListView           *list      __attribute__((unused)),
-                                 VisualNode         *listItem  __attribute__((unused)),
+                                 VisualNode         *listItem,
                                  const QString      &type      __attribute__((unused)),
                                  const QVariantList &indexPath __attribute__((unused)),
-                                 const QVariant     &data      __attribute__((unused)) ) override
+                                 const QVariant     &data ) override
                 {
+                    auto *content = qobject_cast<Container*>( listItem );
+                    auto *image_view = qobject_cast<ImageView*>( content->at(0) );
+                    auto *label = qobject_cast<Label*>( qobject_cast<Container*>( content->at(1) )->at(0) );
+                    const auto &meta = data.toMap().value( "meta" ).toMap();
+                    const auto &thumbnail = data.toMap().value( "thumbnail" ).toByteArray();
+
+                    // The header is read in the background; until then this is a blank item.
+                    if( thumbnail.isEmpty() )
+                        image_view->setImageSource( QUrl("asset:///ic_noboxart.png") );
+                    else
+                        image_view->setImage( Image( thumbnail ) );
+
+                    const QString &when = meta.contains( "timestamp" ) ? QDateTime::fromMSecsSinceEpoch( meta.value( "timestamp" ).toLongLong() ).toString( Qt::SystemLocaleShortDate ) : QString();
+                    const qint64 minutes = meta.value( "playTime" ).toLongLong() / 60000;
+
+                    if( data.toMap().value( "resume" ).toBool() )
+                        label->setText( "Resume" );
+                    else if( !when.isEmpty() )
+                        label->setText( when + QString(" (%1:%2)").arg( minutes / 60 ).arg( minutes % 60, 2, 10, QChar('0') ) );
+                    else
+                        label->setText( QString() );
                 }
 
             public:
@@ -763,13 +1207,20 @@ class GameLibraryUI: public QObject
             {
                 if( type == "states" )
                 {
+                    ListView *states_list = ListView::create().parent( list )
+                                                              .layout( StackListLayout::create().parent( list )
+                                                                                                .orientation( LayoutOrientation::LeftToRight ) )
+                                                              .preferredHeight( list->ui()->du( 30.0f ) )
+                                                              .top( list->ui()->du( 1.0f ) );
+
+                    // The delete action is the list's child so the handler can find the list.
+                    states_list->addActionSet( ActionSet::create().parent( states_list )
+                                                                  .add( DeleteActionItem::create().parent( states_list )
+                                                                                                  .onTriggered( handler, SLOT(onStateDeleteTriggered()) ) ) );
+
                     return Container::create().parent( list )
                                               .add( Header::create().parent( list ) )
-                                              .add( ListView::create().parent( list )
-                                                                      .layout( StackListLayout::create().parent( list )
-                                                                                                        .orientation( LayoutOrientation::LeftToRight ) )
-                                                                      .preferredHeight( list->ui()->du( 30.0f ) )
-                                                                      .top( list->ui()->du( 1.0f ) ) ) ;
+                                              .add( states_list );
                 }
                 else
                 {
@@ -780,7 +1231,7 @@ class GameLibraryUI: public QObject
             void updateItem( ListView           *list      __attribute__((unused)),
                              VisualNode         *listItem,
                              const QString      &type      __attribute__((unused)),
-                             const QVariantList &indexPath __attribute__((unused)),
+                             const QVariantList &indexPath,
                              const QVariant     &data ) override
             {
                 if( type == "states" )
@@ -790,14 +1241,27 @@ class GameLibraryUI: public QObject
                     // add a standard header
                     qobject_cast<Header*>( content->at(0) )->setTitle( data.toMap().value( "title" ).toString() );
 
-                    // add ListView for saves
-                    qobject_cast<ListView*>( content->at(1) )->setListItemProvider( new SaveItem( listItem ) );
-                    qobject_cast<ListView*>( content->at(1) )->setDataModel( new ArrayDataModel( data.toMap().value( "states" ).toList(), listItem ) );
+                    // add ListView for saves, headers are paged in as they scroll into view.
+                    auto *states_list = qobject_cast<ListView*>( content->at(1) );
+                    states_list->setProperty( "row", indexPath.value(0) );
+
+                    if( !states_list->listItemProvider() )
+                        states_list->setListItemProvider( new SaveItem( listItem ) );
+
+                    DataModel *previous = states_list->dataModel();
+                    states_list->setDataModel( new StateListModel( data.toMap(), listItem ) );
+
+                    if( previous )
+                        previous->deleteLater();
+
+                    connect( states_list, SIGNAL(triggered(QVariantList)), handler, SLOT(onStateTriggered(QVariantList)), Qt::UniqueConnection );
                 }
             }
 
+            QObject *handler;
+
         public:
-            SaveItems( QObject *parent ): ListItemProvider( parent )
+            SaveItems( QObject *parent ): ListItemProvider( parent ), handler( parent )
             {
             }
         };
@@ -816,6 +1280,10 @@ class GameLibraryUI: public QObject
         Q_ASSERT(connection);
         connection = connect( save_list_view, SIGNAL(triggered(QVariantList)), this, SLOT(onSavesListTriggered(QVariantList)) );
         Q_ASSERT(connection);
+        connection = connect( data_model, SIGNAL(loaded()), this, SLOT(buildTitleIndex()) );
+        Q_ASSERT(connection);
+        connection = connect( data_model, SIGNAL(batchApplied()), this, SLOT(refreshSearch()) );
+        Q_ASSERT(connection);
 
 
         /*
@@ -827,12 +1295,10 @@ class GameLibraryUI: public QObject
 
     Q_SLOT void onAboutToQuit()
     {
-        if( !import_watcher.isNull() )
+        if( !import_pipeline.isNull() )
         {
-            import_watcher->cancel();
-            import_watcher->waitForFinished();
-
-            QMutexLocker lk(&import_watcher_mutex);
+            delete import_pipeline;
+            saveDataBase();
         }
     }
 
@@ -852,19 +1318,49 @@ public:
         boxart_picker->setTitle( "Select Image" );
         boxart_picker->setDirectories( QStringList("/accounts/1000/shared/photos") );
 
+        patch_picker->setViewMode( FilePickerViewMode::ListView );
+        patch_picker->setMode( FilePickerMode::PickerMultiple );
+        patch_picker->setType( FileType::Other );
+        patch_picker->setTitle( "Select Patches" );
+        patch_picker->setFilter( QStringList() << "*.ips" << "*.bps" );
+        patch_picker->setDirectories( QStringList("/accounts/1000/shared/downloads") );
+
         import_picker->setViewMode( FilePickerViewMode::ListView );
         import_picker->setMode( FilePickerMode::PickerMultiple );
         import_picker->setType( FileType::Other );
         import_picker->setTitle( "Select ROM" );
-        import_picker->setFilter( QStringList() << "*.bin" << "*.md" << "*.sms" << "*.gg" );
+        import_picker->setFilter( QStringList() << "*.bin" << "*.md" << "*.sms" << "*.gg" << "*.zip" );
         import_picker->setDirectories( QStringList("/accounts/1000/shared/downloads") );
 
+        // The saver modes are the only way to have the picker return a folder.
+        import_folder_picker->setViewMode( FilePickerViewMode::ListView );
+        import_folder_picker->setMode( FilePickerMode::SaverMultiple );
+        import_folder_picker->setType( FileType::Other );
+        import_folder_picker->setTitle( "Select Folder" );
+        import_folder_picker->setDirectories( QStringList("/accounts/1000/shared/downloads") );
+
+        // Coalesce library writes while importing.
+        save_timer->setSingleShot( true );
+        save_timer->setInterval( 1000 );
+
         bool connection;
         Q_UNUSED( connection );
         connection = connect( import_picker, SIGNAL(fileSelected(const QStringList&)), this, SLOT(importGames(const QStringList&)) );
         Q_ASSERT( connection );
+        connection = connect( import_folder_picker, SIGNAL(fileSelected(const QStringList&)), this, SLOT(importGames(const QStringList&)) );
+        Q_ASSERT( connection );
         connection = connect( Application::instance(), SIGNAL(aboutToQuit()), this, SLOT(onAboutToQuit()) );
         Q_ASSERT( connection );
+        connection = connect( import_toast, SIGNAL(finished(bb::system::SystemUiResult::Type)), this, SLOT(onImportToastFinished(bb::system::SystemUiResult::Type)) );
+        Q_ASSERT( connection );
+        connection = connect( save_timer, SIGNAL(timeout()), this, SLOT(saveDataBase()) );
+        Q_ASSERT( connection );
+        connection = connect( &genesis_view_ui, SIGNAL(suspended(const QString&, const QString&)), this, SLOT(onSuspended(const QString&, const QString&)) );
+        Q_ASSERT( connection );
+        connection = connect( &genesis_view_ui, SIGNAL(stateSaved(const QString&, const QString&)), this, SLOT(onStateSaved(const QString&, const QString&)) );
+        Q_ASSERT( connection );
+        connection = connect( &genesis_view_ui, SIGNAL(recordingSaved(const QString&)), this, SLOT(onRecordingSaved(const QString&)) );
+        Q_ASSERT( connection );
     }
 
 
@@ -13,11 +13,38 @@ extern "C" {
 #endif
 }
 
+#include "AudioSink.hpp"
+#include "AudioFilter.hpp"
+#include "AudioStretch.hpp"
+#include "CddaDecoder.hpp"
+#ifdef MARKV_DISCCACHE
+#include "DiscCache.hpp"
+#endif
+#include "FramePacer.hpp"
+#include "FramePipeline.hpp"
+#include "Profile.hpp"
+#include "RomPatcher.hpp"
+#include "SessionRecorder.hpp"
+#include "Snapshot.hpp"
+#include "Trace.hpp"
+#include "CoverPreview.hpp"
+#include "ScreenshotWriter.hpp"
+#include "VideoPresenter.hpp"
+
+
+#include <QDebug>
 #include <QMutex>
+#include <QTimer>
 #include <QObject>
+#include <QDateTime>
+#include <QAtomicInt>
+#include <QElapsedTimer>
+#include <QFutureWatcher>
+#include <QtConcurrentRun>
 
-#include <screen/screen.h>
-#include <sys/asoundlib.h>
+#include <malloc.h>
+#include <unistd.h>
+#include <sys/mman.h>
 
 #include <bb/device/DeviceInfo>
 #include <bb/platform/HomeScreen>
@@ -43,12 +70,13 @@ extern "C" {
 using namespace bb::cascades;
 
 
-// TODO add save and load state support from toolbar.
 // TODO add cheats support to toolbar.
 // TODO add miracast support to toolbar.
 // TODO add render filter to toolbar.
 class Genesis: public QObject
 {
+    bool backup;
+
     uint8_t brm_format[0x40] =
     {
         0x5f,0x5f,0x5f,0x5f,0x5f,0x5f,0x5f,0x5f,0x5f,0x5f,0x5f,0x00,0x00,0x00,0x00,0x40,
@@ -66,8 +94,22 @@ public:
     static constexpr auto VIDEO_HEIGHT = 224;
 
 
-    Genesis(const QString &rom, QObject *parent = nullptr): QObject(parent)
+    /*
+     *      Set up what outlives a single game once per process:
+     *      error log, config defaults and the byteswapped BOOT ROM.
+     * */
+    static void warmUp()
     {
+        static bool warm = false;
+        static int bios = 0;
+
+        if (warm)
+        {
+            /* the last game may have changed the flag, the BOOT ROM itself is untouched */
+            system_bios = (system_bios & ~SYSTEM_MD) | bios;
+            return;
+        }
+
         FILE *fp = NULL;
 
         error_init();
@@ -103,6 +145,17 @@ public:
             }
         }
 
+        bios = system_bios & SYSTEM_MD;
+        warm = true;
+    }
+
+
+    Genesis(const QString &rom, QObject *parent = nullptr, bool backup = true): QObject(parent), backup(backup)
+    {
+        FILE *fp = NULL;
+
+        warmUp();
+
         bitmap.width  = VIDEO_WIDTH;
         bitmap.height = VIDEO_HEIGHT;
 
@@ -113,12 +166,12 @@ public:
             fflush(stderr);
         }
 
-        /* initialize system hardware */
+        /* initialize system hardware, audio depends on the region just loaded */
         audio_init(SOUND_FREQUENCY, 0);
         system_init();
 
         /* Mega CD specific */
-        if (system_hw == SYSTEM_MCD)
+        if (system_hw == SYSTEM_MCD && backup)
         {
            /* load internal backup RAM */
            fp = fopen("data/scd.brm", "rb");
@@ -168,7 +221,7 @@ public:
            }
         }
 
-        if (sram.on)
+        if (sram.on && backup)
         {
            /* load SRAM */
            fp = fopen("data/game.srm", "rb");
@@ -188,7 +241,7 @@ public:
     {
         FILE *fp = NULL;
 
-        if (system_hw == SYSTEM_MCD)
+        if (system_hw == SYSTEM_MCD && backup)
         {
             /* save internal backup RAM (if formatted) */
             if (!memcmp(scd.bram + 0x2000 - 0x20, brm_format + 0x20, 0x20))
@@ -216,7 +269,7 @@ public:
             }
         }
 
-        if (sram.on)
+        if (sram.on && backup)
         {
             /* save SRAM */
             fp = fopen("data/game.srm", "wb");
@@ -227,8 +280,75 @@ public:
             }
         }
 
+        /* the error log stays open for the next game */
         audio_shutdown();
-        error_shutdown();
+    }
+
+
+    /*
+     *      Give back the pages behind the ROM and Mega CD areas. Only
+     *      valid while no Genesis exists; the next one loads them
+     *      again. Returns the number of bytes released.
+     * */
+    static size_t releaseMemory()
+    {
+        size_t released = releasePages(cart.rom, cart.romsize);
+
+        if (system_hw == SYSTEM_MCD)
+            released += releasePages(&scd, sizeof(scd));
+
+        return released;
+    }
+
+
+    /* Map fresh zero pages over the whole pages of a range, dropping the old ones. */
+    static size_t releasePages(void *address, size_t size)
+    {
+        const uintptr_t page  = sysconf(_SC_PAGESIZE);
+        const uintptr_t begin = ((uintptr_t)address + page - 1) & ~(page - 1);
+        const uintptr_t end   = ((uintptr_t)address + size) & ~(page - 1);
+
+        if (end <= begin)
+            return 0;
+
+        if (mmap((void *)begin, end - begin, PROT_READ | PROT_WRITE, MAP_FIXED | MAP_PRIVATE | MAP_ANON, -1, 0) == MAP_FAILED)
+        {
+            perror("mmap");
+            return 0;
+        }
+
+        return end - begin;
+    }
+
+
+    /* Frames per second of the loaded game, PAL or NTSC. */
+    static double frameRate()
+    {
+        return vdp_pal ? 49.701 : 59.922;
+    }
+
+
+    /*
+     *      Run the emulated system for exactly one frame. The caller
+     *      profiles it together with the audio_update that follows,
+     *      which is where the YM2612 and PSG finish the frame.
+     * */
+    void frame()
+    {
+        TRACE_SPAN("system_frame");
+
+        if (system_hw == SYSTEM_MCD)
+        {
+           system_frame_scd(0);
+        }
+        else if ((system_hw & SYSTEM_PBC) == SYSTEM_MD)
+        {
+           system_frame_gen(0);
+        }
+        else
+        {
+           system_frame_sms(0);
+        }
     }
 };
 
@@ -240,8 +360,6 @@ class GenesisViewUI: public QObject
 
     class ScreenThread: public QThread
     {
-        int rect[4] = { 0, 0, Genesis::VIDEO_WIDTH, Genesis::VIDEO_HEIGHT };
-
         GenesisViewUI *instance;
 
         void run() override
@@ -250,46 +368,78 @@ class GenesisViewUI: public QObject
             {
                 QMutexLocker locker(&instance->sleep_video);
 
-                screen_post_window(instance->screen_win, instance->screen_buf, 1, rect, SCREEN_WAIT_IDLE);
+                if(instance->threaded_render)
+                {
+                    TRACE_SPAN("FramePipeline::present");
+                    instance->frame_pipeline.present( instance->video_presenter->buffer().data );
+                }
+
+                {
+                    TRACE_SPAN("VideoPresenter::post");
+                    instance->video_presenter->post();
+                }
+
+                instance->frame_pacer.vsync();
             }
         }
 
     public:
-        ScreenThread(GenesisViewUI *parent): QThread(parent), instance(parent) {}
+        ScreenThread(GenesisViewUI *parent): QThread(parent), instance(parent) { setObjectName("video"); }
     };
 
 
     class AudioThread: public QThread
     {
         int16_t soundframe[Genesis::SOUND_SAMPLES_SIZE];
+        int16_t stretched[Genesis::SOUND_SAMPLES_SIZE + 64];
 
         GenesisViewUI *instance;
 
         void run() override
         {
-            while(instance->running)
+            while(instance->frame_pacer.wait())
             {
                 QMutexLocker locker(&instance->sleep_audio);
 
-                if (system_hw == SYSTEM_MCD)
-                {
-                   system_frame_scd(0);
-                }
-                else if ((system_hw & SYSTEM_PBC) == SYSTEM_MD)
+                if(instance->threaded_render)
+                    bitmap.data = instance->frame_pipeline.draw();
+
+                int samples;
                 {
-                   system_frame_gen(0);
+                    PROFILE_FRAME();
+                    instance->genesis->frame();
+
+                    TRACE_SPAN("audio_update");
+                    samples = audio_update(soundframe);
                 }
-                else
+
+                if(instance->screenshot_pending.fetchAndStoreOrdered(0))
+                    instance->captureScreenshot();
+
+                instance->cover_preview->capture();
+
+                if(instance->threaded_render)
+                    instance->frame_pipeline.finish();
+
+                if(instance->audio_filter.isEnabled())
                 {
-                   system_frame_sms(0);
+                    TRACE_SPAN("AudioFilter::process");
+                    instance->audio_filter.process(soundframe, samples);
                 }
 
-                snd_pcm_plugin_write(instance->pcm_handle, soundframe, audio_update(soundframe) * sizeof(int));
+                instance->session_recorder->capture( bitmap.data + bitmap.viewport.y * bitmap.pitch + bitmap.viewport.x * sizeof(uint16_t),
+                                                     bitmap.pitch, bitmap.viewport.w, bitmap.viewport.h, soundframe, samples );
+
+                const double ratio = instance->frame_pacer.audioRatio();
+                samples = instance->audio_stretch.process(soundframe, samples, ratio, stretched);
+
+                TRACE_SPAN("AudioSink::write");
+                instance->audio_sink->write(stretched, samples);
             }
         }
 
     public:
-        AudioThread(GenesisViewUI *parent): QThread(parent), instance(parent) {}
+        AudioThread(GenesisViewUI *parent): QThread(parent), instance(parent) { setObjectName("emulation"); }
     };
 
     bool paused  = false;
@@ -298,6 +448,14 @@ class GenesisViewUI: public QObject
     QMutex sleep_audio;
     QMutex sleep_video;
 
+    /* The video thread's vsyncs decide when the audio thread runs a frame. */
+    FramePacer frame_pacer;
+    AudioStretch audio_stretch;
+
+    /* With settings.threadedRender the core draws into these and the video thread copies. */
+    FramePipeline frame_pipeline;
+    bool threaded_render = false;
+
     QString BUTTON_A     = "i";
     QString BUTTON_B     = "o";
     QString BUTTON_C     = "p";
@@ -311,6 +469,26 @@ class GenesisViewUI: public QObject
     QThread *audio_thread = new AudioThread(this);
     QThread *video_thread = new ScreenThread(this);
 
+    QVariantMap game;
+
+    /* Screenshots are copied at a frame boundary and encoded off thread. */
+    ScreenshotWriter *screenshot_writer = new ScreenshotWriter(Genesis::VIDEO_WIDTH, Genesis::VIDEO_HEIGHT, this);
+    QTimer *screenshot_timer = new QTimer(this);
+    QAtomicInt screenshot_pending;
+    QMutex screenshot_mutex;
+    QString screenshot_file;
+    int screenshot_count = 0;
+
+    /* data/<gameID>_auto<n>.png, kept apart from HeadlessRunner's data/<gameID>_<n>.png thumbnails. */
+    static constexpr auto AUTO_SCREENSHOTS = 4;
+
+    /* Started and stopped from the option bar. */
+    SessionRecorder *session_recorder = new SessionRecorder(this);
+    QString recording_name;
+
+    /* Optional live view of the game in the active frame. */
+    CoverPreview *cover_preview = new CoverPreview(&frame_pipeline, this);
+
     Sheet *sheet = Sheet::create().parent(this)
                                   .peek(false)
                                   .connect(SIGNAL(closed()), this, SLOT(closeROM()));
@@ -331,25 +509,229 @@ class GenesisViewUI: public QObject
                                                                                                                                 .defaultImage( QUrl("asset:///ic_save.png") )
                                                                                                                                 .vertical( VerticalAlignment::Center )
                                                                                                                                 .horizontal( HorizontalAlignment::Center )
-                                                                                                                                .preferredSize( sheet->ui()->du(11.0f), sheet->ui()->du(11.0f) ) )
+                                                                                                                                .preferredSize( sheet->ui()->du(11.0f), sheet->ui()->du(11.0f) )
+                                                                                                                                .connect( SIGNAL(clicked()), this, SLOT(quickSave()) ) )
                                                                                                      .add( ImageButton::create().parent(this)
                                                                                                                                 .defaultImage( QUrl("asset:///ic_load.png") )
                                                                                                                                 .vertical( VerticalAlignment::Center )
                                                                                                                                 .horizontal( HorizontalAlignment::Center )
-                                                                                                                                .preferredSize( sheet->ui()->du(11.0f), sheet->ui()->du(11.0f) ) ) ) );
+                                                                                                                                .preferredSize( sheet->ui()->du(11.0f), sheet->ui()->du(11.0f) )
+                                                                                                                                .connect( SIGNAL(clicked()), this, SLOT(quickLoad()) ) )
+                                                                                                     .add( ImageButton::create().parent(this)
+                                                                                                                                .defaultImage( QUrl("asset:///ic_record.png") )
+                                                                                                                                .vertical( VerticalAlignment::Center )
+                                                                                                                                .horizontal( HorizontalAlignment::Center )
+                                                                                                                                .preferredSize( sheet->ui()->du(11.0f), sheet->ui()->du(11.0f) )
+                                                                                                                                .connect( SIGNAL(clicked()), this, SLOT(toggleRecording()) ) ) ) );
+
+    /* Where the frames go, see VideoPresenter for the settings. */
+    VideoPresenter *video_presenter = nullptr;
+
+    /* Where the sound goes, see AudioSink for the settings. */
+    AudioSink *audio_sink = nullptr;
+
+    /* Run on the emulation thread, set up from settings.audioFilter. */
+    AudioFilter audio_filter;
+
+    /* From openROM to the game's window being shown. */
+    QElapsedTimer open_timer;
+
+    /* Time played, carried over from the resume state. The clock only runs while not paused. */
+    qint64 play_time = 0;
+    QElapsedTimer play_clock;
+
+    /* What the load button restores. */
+    QString last_state;
 
-    /* Screen API Handles */
-    screen_context_t screen_ctx = nullptr;
-    screen_window_t  screen_win = nullptr;
-    screen_buffer_t  screen_buf = nullptr;
+    /* The last suspend, still being written while the library is shown again. */
+    QFuture<bool> suspend_write;
+    QString suspend_id;
 
-    /* QSA Handles */
-    snd_pcm_t *pcm_handle = nullptr;
+    /* The ROM, or its patched image when the game has patches. */
+    QString rom_file;
+
+    /* The window the game is shown in, kept to rejoin it after hibernating. */
+    QByteArray window_id;
+    QByteArray window_group;
+
+    /* While hibernating the core is gone and these hold its state and last frame, compressed. */
+    static constexpr auto HIBERNATE_AFTER = 300;
+    QTimer *hibernate_timer = new QTimer(this);
+    QByteArray hibernated;
+    Snapshot::Frame hibernated_frame;
 
     bb::device::DeviceInfo device_info;
     bb::platform::HomeScreen home_screen;
 
 
+    void captureScreenshot()
+    {
+        QMutexLocker lk(&screenshot_mutex);
+
+        screenshot_writer->capture( bitmap.data + bitmap.viewport.y * bitmap.pitch + bitmap.viewport.x * sizeof(uint16_t),
+                                    bitmap.pitch, bitmap.viewport.w, bitmap.viewport.h, screenshot_file );
+    }
+
+
+    Q_SLOT void autoScreenshot()
+    {
+        if(running && !paused)
+            saveScreenshot( "data/", game.value("gameID").toString() + "_auto" + QString::number(screenshot_count++ % AUTO_SCREENSHOTS) + ".png" );
+
+        screenshot_timer->start( (60 + qrand() % 120) * 1000 );
+    }
+
+
+    /*
+     *      Write the state in the background. The caller must have
+     *      stopped or paused the emulation thread.
+     * */
+    QFuture<bool> writeState(const QString &file, const char *done)
+    {
+        auto *watcher = new QFutureWatcher<bool>(this);
+        watcher->setProperty("file", file);
+        watcher->setProperty("gameID", game.value("gameID"));
+
+        bool connection;
+        connection = connect( watcher, SIGNAL(finished()), this, done );
+        Q_ASSERT( connection );
+        Q_UNUSED( connection );
+
+        QVariantMap meta;
+        meta["gameID"] = game.value("gameID");
+        meta["title"] = game.value("title");
+        meta["timestamp"] = QDateTime::currentMSecsSinceEpoch();
+        meta["playTime"] = playTime();
+        meta["patchKey"] = RomPatcher::key( "data/" + game.value("gameID").toString() + ".bin", rom_file );
+
+        // Only the copies are made here; the thumbnail and compression happen on the pool.
+        watcher->setFuture( QtConcurrent::run(&Snapshot::write, file, Snapshot::capture(), Snapshot::grab(), meta) );
+        return watcher->future();
+    }
+
+
+    qint64 playTime() const
+    {
+        return play_time + (play_clock.isValid() ? play_clock.elapsed() : 0);
+    }
+
+
+    Q_SLOT void onSuspended()
+    {
+        auto *watcher = static_cast<QFutureWatcher<bool>*>( sender() );
+
+        if(watcher->result())
+            emit suspended( watcher->property("gameID").toString(), watcher->property("file").toString() );
+
+        watcher->deleteLater();
+    }
+
+
+    Q_SLOT void onStateWritten()
+    {
+        auto *watcher = static_cast<QFutureWatcher<bool>*>( sender() );
+
+        if(watcher->result())
+        {
+            last_state = watcher->property("file").toString();
+            emit stateSaved( watcher->property("gameID").toString(), last_state );
+        }
+
+        watcher->deleteLater();
+    }
+
+
+    /*
+     *      The audio sink is opened once and kept between games.
+     * */
+    void openAudio()
+    {
+        if(!audio_sink)
+            audio_sink = AudioSink::create(Genesis::SOUND_FREQUENCY);
+
+        audio_sink->prepare();
+    }
+
+
+    /*
+     *      The window and its buffer are made once and kept between
+     *      games. False if they can't be, and there's nothing to
+     *      draw into.
+     * */
+    bool openPresenter(const QByteArray &id)
+    {
+        if(video_presenter)
+            return true;
+
+        video_presenter = VideoPresenter::create();
+
+        if(!video_presenter->open(id, Genesis::VIDEO_WIDTH, Genesis::VIDEO_HEIGHT))
+        {
+            qWarning() << "GenesisViewUI: the video presenter did not open";
+
+            delete video_presenter;
+            video_presenter = nullptr;
+            return false;
+        }
+
+        const auto &buffer = video_presenter->buffer();
+        bitmap.pitch = buffer.pitch;
+        bitmap.data  = buffer.data;
+
+        return true;
+    }
+
+
+    /*
+     *      Each game's ForeignWindowControl picks the window up
+     *      again when it rejoins the group.
+     * */
+    void openScreen(const QByteArray &id, const QByteArray &group)
+    {
+        openPresenter(id);
+
+        video_presenter->attach(group);
+        video_presenter->resetTiming();
+    }
+
+
+    /*
+     *      Point the core at the presenter's buffer, or at the
+     *      pipeline's starting from what the presenter shows.
+     * */
+    void attachBitmap()
+    {
+        const auto &buffer = video_presenter->buffer();
+        bitmap.pitch = buffer.pitch;
+        bitmap.data  = buffer.data;
+
+        if(threaded_render)
+        {
+            frame_pipeline.open(buffer.data, buffer.pitch, Genesis::VIDEO_HEIGHT);
+            bitmap.data = frame_pipeline.current();
+        }
+    }
+
+
+    /*
+     *      Give the devices back, e.g. when the app goes away.
+     * */
+    void closeDevices()
+    {
+        delete audio_sink;
+        audio_sink = nullptr;
+
+        closeScreen();
+    }
+
+
+    void closeScreen()
+    {
+        delete video_presenter;
+        video_presenter = nullptr;
+    }
+
+
     Q_SLOT void keyPressed(bb::cascades::KeyEvent *event)
     {
         const QString &key = event->unicode();
@@ -425,14 +807,28 @@ class GenesisViewUI: public QObject
     }
 
 
+    Q_SLOT void onAttached()
+    {
+        qDebug() << "openROM:" << game.value("gameID").toString() << "on screen after" << open_timer.elapsed() << "ms";
+    }
+
+
     Q_SLOT void onThumbnail()
     {
-        pause();
+        if(game.value("settings").toMap().value("livePreview").toBool())
+            cover_preview->start();
+        else
+        {
+            pause();
+            startIdle();
+        }
     }
 
 
     Q_SLOT void onFullscreen()
     {
+        cover_preview->stop();
+
         if(!toolbar)
             resume();
     }
@@ -446,7 +842,110 @@ class GenesisViewUI: public QObject
 
     Q_SLOT void onActivityStateChanged(bb::device::UserActivityState::Type type)
     {
-        if(type == bb::device::UserActivityState::Inactive) pause();
+        if(type == bb::device::UserActivityState::Inactive)
+        {
+            pause();
+            startIdle();
+        }
+    }
+
+
+    /*
+     *      Count down to hibernating while paused in the background.
+     *      settings.hibernateAfter is in seconds, 0 turns it off.
+     * */
+    void startIdle()
+    {
+        const int after = game.value("settings").toMap().value("hibernateAfter", HIBERNATE_AFTER).toInt();
+
+        if(paused && after > 0 && hibernated.isEmpty())
+            hibernate_timer->start(after * 1000);
+    }
+
+
+    static qint64 heapInUse()
+    {
+        return mallinfo().uordblks;
+    }
+
+
+    /*
+     *      Drop the core, its ROM and Mega CD pages and the screen
+     *      buffers while paused, keeping only a compressed copy of the
+     *      state and the last frame. The emulation threads are parked
+     *      on the pause locks and never see the gap.
+     * */
+    Q_SLOT void hibernate()
+    {
+        if(!running || !paused || !hibernated.isEmpty())
+            return;
+
+        QElapsedTimer timer;
+        timer.start();
+
+        const qint64 heap = heapInUse();
+        const qint64 screen_size = (qint64)bitmap.pitch * Genesis::VIDEO_HEIGHT;
+        const qint64 pipeline_size = frame_pipeline.size();
+
+        hibernated = qCompress(Snapshot::capture(), 6);
+        hibernated_frame = Snapshot::grab();
+        hibernated_frame.pixels = qCompress(hibernated_frame.pixels, 1);
+
+        delete genesis;
+        genesis = nullptr;
+
+        const size_t pages = Genesis::releaseMemory();
+
+        video_presenter->detach();
+        closeScreen();
+        frame_pipeline.close();
+
+        qDebug() << "hibernate:" << game.value("gameID").toString() << "in" << timer.elapsed() << "ms,"
+                 << "heap" << heap / 1024 << "KB ->" << heapInUse() / 1024 << "KB,"
+                 << "released" << pages / 1024 << "KB of core pages, a" << screen_size / 1024 << "KB screen buffer and"
+                 << pipeline_size / 1024 << "KB of frame pipeline buffers,"
+                 << "holding" << (hibernated.size() + hibernated_frame.pixels.size()) / 1024 << "KB of state and frame";
+    }
+
+
+    /*
+     *      Bring the core and screen back exactly as they were.
+     * */
+    void wake()
+    {
+        hibernate_timer->stop();
+
+        if(hibernated.isEmpty())
+            return;
+
+        QElapsedTimer timer;
+        timer.start();
+
+        openScreen(window_id, window_group);
+        genesis = new Genesis(rom_file, this);
+
+        if(!Snapshot::restore( qUncompress(hibernated) ))
+            qWarning() << "wake: could not restore" << game.value("gameID").toString();
+
+        // Put the last frame back so the new buffer isn't blank until the next one.
+        // bitmap still points at the buffer hibernate() gave back until attachBitmap().
+        const auto &buffer = video_presenter->buffer();
+        const QByteArray &pixels = qUncompress(hibernated_frame.pixels);
+
+        if(pixels.size() == hibernated_frame.width * hibernated_frame.height * (int)sizeof(uint16_t))
+        {
+            for(int y = 0; y < hibernated_frame.height; y++)
+                memcpy( buffer.data + (bitmap.viewport.y + y) * buffer.pitch + bitmap.viewport.x * sizeof(uint16_t),
+                        pixels.constData() + y * hibernated_frame.width * sizeof(uint16_t),
+                        hibernated_frame.width * sizeof(uint16_t) );
+        }
+
+        attachBitmap();
+
+        hibernated.clear();
+        hibernated_frame = Snapshot::Frame();
+
+        qDebug() << "wake:" << game.value("gameID").toString() << "in" << timer.elapsed() << "ms, heap" << heapInUse() / 1024 << "KB";
     }
 
 
@@ -455,6 +954,17 @@ public:
     //
     GenesisViewUI(QObject *parent = nullptr): QObject( parent )
     {
+        screenshot_timer->setSingleShot(true);
+        hibernate_timer->setSingleShot(true);
+
+        bool connection;
+        connection = connect( screenshot_writer, SIGNAL(screenshotSaved(const QString&)), this, SIGNAL(screenshotSaved(const QString&)) );
+        Q_ASSERT( connection );
+        connection = connect( screenshot_timer, SIGNAL(timeout()), this, SLOT(autoScreenshot()) );
+        Q_ASSERT( connection );
+        connection = connect( hibernate_timer, SIGNAL(timeout()), this, SLOT(hibernate()) );
+        Q_ASSERT( connection );
+        Q_UNUSED( connection );
     }
 
 
@@ -463,19 +973,34 @@ public:
     ~GenesisViewUI()
     {
         closeROM();
+        closeDevices();
     }
 
 
     bool isPaused() { return paused; }
-    bool isRunning() { return running && screen_ctx; }
+    bool isRunning() { return running && video_presenter; }
 
 
-    //
-    //
-    Q_SLOT void openROM(const QVariantMap &game)
+    /*
+     *      Where a game's state is kept between sessions.
+     * */
+    static QString resumeFile(const QVariantMap &game)
+    {
+        return "data/" + game.value("gameID").toString() + ".resume";
+    }
+
+
+    /*
+     *      Open a game where it was left, or from the start with
+     *      restart, leaving its resume state for the next suspend
+     *      to replace.
+     * */
+    Q_SLOT void openROM(const QVariantMap &game, bool restart = false)
     {
         if(!running)
         {
+            open_timer.start();
+
             /* *
              *      Cascades UI
              */
@@ -497,6 +1022,18 @@ public:
             root->addKeyListener( KeyListener::create().parent( root )
                                                        .onKeyPressed( this, SLOT(keyPressed(bb::cascades::KeyEvent*)) )
                                                        .onKeyReleased( this, SLOT(keyReleased(bb::cascades::KeyEvent*)) ) );
+
+            /* Devices are set up by the first game and kept. Without a screen there's no game. */
+            window_id = emulator_view->windowId().toAscii();
+            window_group = emulator_view->windowGroup().toAscii();
+
+            if(!openPresenter(window_id))
+            {
+                qWarning() << "openROM: can't show" << game.value("gameID").toString();
+                delete root;
+                return;
+            }
+
             sheet->setContent( root );
             sheet->open();
 
@@ -517,159 +1054,78 @@ public:
             Q_ASSERT( connection );
             connection = connect( emulator_view, SIGNAL(windowAttached(screen_window_t, const QString&, const QString&)), this, SIGNAL(opened()) );
             Q_ASSERT( connection );
+            connection = connect( emulator_view, SIGNAL(windowAttached(screen_window_t, const QString&, const QString&)), this, SLOT(onAttached()) );
+            Q_ASSERT( connection );
             Q_UNUSED( connection );
 
 
 
+            threaded_render = game.value("settings").toMap().value("threadedRender").toBool();
+
+            openAudio();
+            openScreen( window_id, window_group );
+            attachBitmap();
+
             /**
-             *      QNX Sound Architecture
-             *
-             * http://www.qnx.com/developers/docs/6.4.0/neutrino/audio/architecture.html
-             * http://www.qnx.com/developers/docs/6.4.0/neutrino/audio/pcm.html
-             * http://www.qnx.com/developers/docs/6.4.0/neutrino/audio/mixer.html
-             *
+             *      Open the ROM and pick up where it was left.
              */
-            snd_pcm_channel_params_t pp;
+            QElapsedTimer timer;
+            timer.start();
 
-            memset(&pp, 0, sizeof(snd_pcm_channel_params_t));
-            pp.mode       = SND_PCM_MODE_BLOCK;
-            pp.channel    = SND_PCM_CHANNEL_PLAYBACK;
-            pp.start_mode = SND_PCM_START_FULL;
-            pp.stop_mode  = SND_PCM_STOP_ROLLOVER_RESET;
+            QString patch_error;
+            rom_file = RomPatcher::prepare( "data/" + game.value("gameID").toString() + ".bin", game.value("gameID").toString(),
+                                            game.value("patches").toStringList(), game.value("patchedCRC").toString(), &patch_error );
 
-            pp.format.interleave = 1;
-            pp.format.rate       = Genesis::SOUND_FREQUENCY;
-            pp.format.voices     = 2;
-            pp.format.format     = SND_PCM_SFMT_S16_LE;
+            if(!patch_error.isEmpty())
+                qWarning() << "openROM: playing" << game.value("gameID").toString() << "unpatched," << patch_error;
 
-            pp.buf.block.frags_max = 5;
-            pp.buf.block.frags_min = 1;
-            pp.buf.block.frag_size = Genesis::SOUND_SAMPLES_SIZE;
+            genesis = new Genesis(rom_file, this);
+            qDebug() << "openROM: core ready in" << timer.elapsed() << "ms," << open_timer.elapsed() << "ms since open";
 
-            int snd_errno = -1;
+            // Closing the game a moment ago may still be writing its resume state.
+            if(suspend_id == game.value("gameID").toString())
+                suspend_write.waitForFinished();
 
-            snd_errno = snd_pcm_open_name(&pcm_handle, "pcmPreferred", SND_PCM_OPEN_PLAYBACK);
-            if( snd_errno < 0 )
-            {
-                fprintf( stderr, "snd_pcm_open_name failed: %s\n", snd_strerror(snd_errno) );
-            }
+            // A resume state taken with other patches is left alone.
+            QVariantMap meta;
+            const QByteArray &state = Snapshot::read(resumeFile(game), &meta);
 
-            snd_errno = snd_pcm_plugin_params(pcm_handle, &pp);
-            if( snd_errno < 0 )
+            if(!state.isEmpty() && meta.value("patchKey").toString() != RomPatcher::key( "data/" + game.value("gameID").toString() + ".bin", rom_file ))
             {
-                fprintf( stderr, "snd_pcm_plugin_params failed: %s\n", snd_strerror(snd_errno) );
+                qDebug() << "openROM: not resuming" << game.value("gameID").toString() << "with other patches";
+                meta.clear();
             }
-
-            snd_errno = snd_pcm_plugin_prepare(pcm_handle, SND_PCM_CHANNEL_PLAYBACK);
-            if( snd_errno < 0 )
+            else if(restart)
             {
-                fprintf( stderr, "snd_pcm_plugin_prepare failed: %s\n", snd_strerror(snd_errno) );
-            }
-
-
-            /**
-             *      QNX Screen API
-             *
-             *      http://www.qnx.com/developers/docs/660/index.jsp?topic=%2Fcom.qnx.doc.screen%2Ftopic%2Fmanual%2Fcscreen_about.html
-             *
-             */
-            const QByteArray &id = emulator_view->windowId().toAscii();
-            const QByteArray &group = emulator_view->windowGroup().toAscii();
-
-            /* Create Screen Context */
-            if( screen_create_context(&screen_ctx, SCREEN_APPLICATION_CONTEXT) ) {
-                perror("screen_create_context");
+                qDebug() << "openROM: restarting" << game.value("gameID").toString();
+                meta.clear();
             }
-
-            /* Create Screen Window */
-            if( screen_create_window_type(&screen_win, screen_ctx, SCREEN_CHILD_WINDOW) ) {
-                perror("screen_create_window_type");
-            }
-
-            /* Create Screen Buffer */
-            if( screen_create_window_buffers(screen_win, 1) ) {
-                perror("screen_create_window_buffers");
-            }
-
-            /* Attach Window to ForignWindowView */
-            if( screen_join_window_group(screen_win, group.constData()) ) {
-                perror("screen_join_window_group");
+            else if(Snapshot::restore(state))
+            {
+                qDebug() << "openROM: resumed" << game.value("gameID").toString() << "in" << timer.elapsed() << "ms";
             }
-
-            if( screen_set_window_property_cv(screen_win, SCREEN_PROPERTY_ID_STRING, id.length(), id.constData()) ) {
-                perror("screen_set_window_property_cv");
+            else
+            {
+                // Starting over, so the play time starts over too.
+                meta.clear();
             }
 
-#ifdef QT_DEBUG
-            int debug = SCREEN_DEBUG_STATISTICS;
-            if( screen_set_window_property_iv(screen_win, SCREEN_PROPERTY_DEBUG, &debug) ) {
-                perror("screen_set_window_property_iv(SCREEN_PROPERTY_DEBUG)");
-            }
+            this->game = game;
+            play_time = meta.value("playTime").toLongLong();
+            play_clock.start();
+            last_state = game.value("states").toList().isEmpty() ? QString() : "data/" + game.value("states").toList().last().toString();
+            screenshot_timer->start( (60 + qrand() % 120) * 1000 );
+
+            frame_pacer.start( Genesis::frameRate() );
+            audio_stretch.reset();
+            audio_filter.configure( game.value("settings").toMap().value("audioFilter").toMap() );
+            Profile::take();
+#ifdef MARKV_DISCCACHE
+            DiscCache::instance().take();
+#endif
+#ifdef MARKV_CDDA
+            CddaDecoder::instance().take();
 #endif
-
-            int z = -5;
-            if( screen_set_window_property_iv(screen_win, SCREEN_PROPERTY_ZORDER, &z) ) {
-                perror("screen_set_window_property_iv(SCREEN_PROPERTY_ZORDER)");
-            }
-
-            int interval = 1;
-            if( screen_set_window_property_iv(screen_win, SCREEN_PROPERTY_SWAP_INTERVAL, &interval) ) {
-                perror("screen_set_window_property_iv(SCREEN_PROPERTY_SWAP_INTERVAL)");
-            }
-
-            int idle_mode = SCREEN_IDLE_MODE_KEEP_AWAKE;
-            if( screen_set_window_property_iv(screen_win, SCREEN_PROPERTY_IDLE_MODE, &idle_mode) ) {
-                perror("screen_set_window_property_iv(SCREEN_PROPERTY_IDLE_MODE)");
-            }
-
-            int usage = SCREEN_USAGE_WRITE;
-            if( screen_set_window_property_iv(screen_win, SCREEN_PROPERTY_USAGE, &usage) ) {
-                perror("screen_set_window_property_iv(SCREEN_PROPERTY_USAGE)");
-            }
-
-            int format = SCREEN_FORMAT_RGB565;
-            if( screen_set_window_property_iv(screen_win, SCREEN_PROPERTY_FORMAT, &format) ) {
-                perror("screen_set_window_property_iv(SCREEN_PROPERTY_FORMAT)");
-            }
-
-            int scale = 16;
-            if( screen_set_window_property_iv(screen_win, SCREEN_PROPERTY_SCALE_FACTOR, &scale) ) {
-                perror("screen_set_window_property_iv(SCREEN_PROPERTY_SCALE_FACTOR)");
-            }
-
-            int scale_quality = SCREEN_QUALITY_FASTEST;
-            if( screen_set_window_property_iv(screen_win, SCREEN_PROPERTY_SCALE_QUALITY, &scale_quality) ) {
-                perror("screen_set_window_property_iv(SCREEN_PROPERTY_SCALE_QUALITY)");
-            }
-
-            int dims[2] = { Genesis::VIDEO_WIDTH, Genesis::VIDEO_HEIGHT };
-            if( screen_set_window_property_iv(screen_win, SCREEN_PROPERTY_SOURCE_SIZE, dims) ) {
-                perror("screen_set_window_property_iv(SCREEN_PROPERTY_SOURCE_SIZE)");
-            }
-
-            int rect[2] = { Genesis::VIDEO_WIDTH, Genesis::VIDEO_HEIGHT };
-            if( screen_set_window_property_iv(screen_win, SCREEN_PROPERTY_BUFFER_SIZE, rect) ) {
-                perror("screen_set_window_property_iv(SCREEN_PROPERTY_BUFFER_SIZE)");
-            }
-
-            /* Get Screen Buffer Attributes */
-            if( screen_get_window_property_pv(screen_win, SCREEN_PROPERTY_RENDER_BUFFERS, (void **)&screen_buf) ) {
-                perror("screen_get_window_property_pv(SCREEN_PROPERTY_RENDER_BUFFERS)");
-            }
-
-            if( screen_get_buffer_property_iv(screen_buf, SCREEN_PROPERTY_STRIDE, &bitmap.pitch) ) {
-                perror("screen_get_buffer_property_pv(SCREEN_PROPERTY_POINTER)");
-            }
-
-            if( screen_get_buffer_property_pv(screen_buf, SCREEN_PROPERTY_POINTER, (void **)&bitmap.data) ) {
-                perror("screen_get_buffer_property_iv(SCREEN_PROPERTY_STRIDE)");
-            }
-
-
-            /**
-             *      Open the ROM.
-             */
-            genesis = new Genesis("data/"+ game.value("gameID").toString() +".bin", this);
 
             paused  = false;
             toolbar = false;
@@ -684,6 +1140,8 @@ public:
     {
         if(running)
         {
+            wake();
+
             if(paused || toolbar)
             {
                 sleep_audio.unlock();
@@ -693,18 +1151,63 @@ public:
             paused  = false;
             toolbar = false;
             running = false;
+            frame_pacer.stop();
 
             audio_thread->wait();
             video_thread->wait();
+            stopRecording();
+            screenshot_timer->stop();
+            screenshot_pending = 0;
+            cover_preview->stop();
             opion_bar->setOpacity(0.0f);
 
-            /* Free QSA resource. */
-            snd_pcm_close(pcm_handle);
+            /* Suspend. The copies are made before the core and screen go away. */
+            suspend_write = writeState( resumeFile(game), SLOT(onSuspended()) );
+            suspend_id = game.value("gameID").toString();
+            play_clock.invalidate();
+
+            /* Keep the devices for the next game. */
+            const auto &timing = video_presenter->timing();
+            const auto &pacing = frame_pacer.stats();
 
-            /* Free Screen API resources */
-            screen_destroy_buffer(screen_buf);
-            screen_destroy_window(screen_win);
-            screen_destroy_context(screen_ctx);
+            qDebug() << "GenesisViewUI: audio latency" << audio_sink->latency() << "ms," << audio_sink->underruns() << "underruns so far";
+            qDebug() << "GenesisViewUI:" << timing.frames << "frames posted every" << timing.interval << "us (worst" << timing.worst_interval << "us), posting took" << timing.cost << "us";
+            qDebug() << "GenesisViewUI: paced to" << pacing.refresh << "Hz, vsync jitter" << pacing.jitter << "us (worst" << pacing.worst << "us),"
+                     << pacing.missed << "missed," << pacing.repeated << "repeated," << pacing.late << "late of" << pacing.vsyncs;
+
+            if(threaded_render)
+            {
+                const auto &pipeline = frame_pipeline.take();
+                qDebug() << "GenesisViewUI: threaded render" << pipeline.presented << "of" << pipeline.frames << "frames presented,"
+                         << pipeline.dropped << "dropped, copying took" << pipeline.copy << "us (worst" << pipeline.worst_copy << "us)";
+            }
+
+            if(audio_filter.isEnabled())
+            {
+                const auto &cost = audio_filter.take();
+                qDebug() << "GenesisViewUI: audio filter" << cost.mean << "ns per block (worst" << cost.worst << "ns) over" << cost.blocks << "blocks";
+            }
+
+            if(system_hw == SYSTEM_MCD)
+            {
+#ifdef MARKV_DISCCACHE
+                const auto &disc = DiscCache::instance().take();
+                qDebug() << "GenesisViewUI: disc cache" << disc.hits << "hits," << disc.misses << "misses," << disc.waits << "waits,"
+                         << "stalled" << disc.stall << "us (worst" << disc.worst_stall << "us)";
+#endif
+#ifdef MARKV_CDDA
+                const auto &cdda = CddaDecoder::instance().take();
+                qDebug() << "GenesisViewUI: cdda" << cdda.decoded / 1024 << "KB decoded," << cdda.seeks << "seeks," << cdda.stalls << "stalls,"
+                         << "stalled" << cdda.stall << "us (worst" << cdda.worst_stall << "us)";
+#endif
+            }
+#ifdef MARKV_PROFILE
+            qDebug() << "GenesisViewUI: profile" << game.value("gameID").toString() << qPrintable( Profile::report( Profile::take() ) );
+#endif
+
+            audio_sink->flush();
+
+            video_presenter->detach();
 
             bool connection;
             connection = disconnect( Application::instance(), SIGNAL(thumbnail()), this, SLOT(onThumbnail()) );
@@ -718,9 +1221,8 @@ public:
             Q_UNUSED( connection );
 
             delete genesis;
-            screen_ctx = nullptr;
-            screen_win = nullptr;
-            screen_buf = nullptr;
+            genesis = nullptr;
+            frame_pipeline.close();
             emit closed("");
         }
     }
@@ -736,7 +1238,10 @@ public:
             sleep_video.lock();
             sleep_audio.lock();
 
-            snd_pcm_channel_pause(pcm_handle, SND_PCM_CHANNEL_PLAYBACK);
+            audio_sink->pause();
+
+            play_time = playTime();
+            play_clock.invalidate();
         }
     }
 
@@ -747,11 +1252,15 @@ public:
     {
         if(paused && running)
         {
+            wake();
+
             paused = false;
             sleep_audio.unlock();
             sleep_video.unlock();
 
-            snd_pcm_channel_resume(pcm_handle, SND_PCM_CHANNEL_PLAYBACK);
+            audio_sink->resume();
+
+            play_clock.start();
         }
     }
 
@@ -760,7 +1269,19 @@ public:
     //
     Q_SLOT void loadState(const QString &file)
     {
-        Q_UNUSED(file);
+        if(!running)
+            return;
+
+        // Pausing waits for the current frame to finish.
+        const bool was_paused = paused;
+        pause();
+        wake();
+
+        if(!Snapshot::restore( Snapshot::read(file) ))
+            qWarning() << "loadState: could not restore" << file;
+
+        if(!was_paused)
+            resume();
     }
 
 
@@ -768,7 +1289,74 @@ public:
     //
     Q_SLOT void saveState(const QString &dir, const QString &name)
     {
-        emit stateSaved(dir+name);
+        if(!running)
+            return;
+
+        const bool was_paused = paused;
+        pause();
+        wake();
+
+        writeState( dir+name, SLOT(onStateWritten()) );
+
+        if(!was_paused)
+            resume();
+    }
+
+
+    /*
+     *      The option bar's buttons.
+     * */
+    Q_SLOT void quickSave()
+    {
+        saveState( "data/", game.value("gameID").toString() + "_" + QString::number(QDateTime::currentMSecsSinceEpoch()) + ".gp0" );
+    }
+
+
+    Q_SLOT void quickLoad()
+    {
+        if(!last_state.isEmpty())
+            loadState(last_state);
+    }
+
+
+    /*
+     *      Record the game, losslessly, to the shared videos folder
+     *      until pressed again or the game is closed.
+     * */
+    Q_SLOT void toggleRecording()
+    {
+        if(!running)
+            return;
+
+        if(session_recorder->isRecording())
+        {
+            stopRecording();
+            return;
+        }
+
+        recording_name = "/accounts/1000/shared/videos/Mark_V-" + game.value("gameID").toString() + "-" + QDateTime::currentDateTime().toString("yyyyMMdd-hhmmss");
+
+        if(!session_recorder->open(recording_name, Genesis::VIDEO_WIDTH, Genesis::VIDEO_HEIGHT, Genesis::frameRate(), Genesis::SOUND_FREQUENCY))
+        {
+            qWarning() << "toggleRecording: could not open" << recording_name;
+            return;
+        }
+
+        qDebug() << "toggleRecording: recording to" << recording_name;
+    }
+
+
+    void stopRecording()
+    {
+        if(!session_recorder->isRecording())
+            return;
+
+        const auto &stats = session_recorder->close();
+
+        qDebug() << "GenesisViewUI: recorded" << stats.frames << "frames to" << recording_name << "," << stats.dropped << "dropped,"
+                 << stats.audio_dropped << "bytes of sound dropped," << stats.bytes / 1024 << "KB written";
+
+        emit recordingSaved(recording_name + ".mkvr");
     }
 
 
@@ -776,13 +1364,28 @@ public:
     //
     Q_SLOT void saveScreenshot(const QString &dir, const QString &name)
     {
-        emit screenshotSaved(dir+name);
+        if(!running || !hibernated.isEmpty())
+            return;
+
+        {
+            QMutexLocker lk(&screenshot_mutex);
+            screenshot_file = dir+name;
+        }
+
+        // The emulation thread is blocked while paused so the
+        // last frame is complete and can be copied right away.
+        if(paused)
+            captureScreenshot();
+        else
+            screenshot_pending = 1;
     }
 
 
 Q_SIGNALS:
     void opened();
     void closed(const QString &file);
-    void stateSaved(const QString &file);
+    void stateSaved(const QString &gameID, const QString &file);
+    void suspended(const QString &gameID, const QString &file);
     void screenshotSaved(const QString &file);
+    void recordingSaved(const QString &file);
 };
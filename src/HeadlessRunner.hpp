@@ -0,0 +1,606 @@
+/*
+ * HeadlessRunner.hpp
+ *
+ *  Created on: Oct 19, 2026
+ *      Author: swatson
+ */
+
+#pragma once
+
+#include "GenesisViewUI.hpp"
+
+
+#include <zlib.h>
+
+#include <cstdio>
+#include <vector>
+#include <algorithm>
+
+
+#include <QFile>
+#include <QImage>
+#include <QThread>
+#include <QRegExp>
+#include <QProcess>
+#include <QFileInfo>
+#include <QEventLoop>
+#include <QStringList>
+#include <QElapsedTimer>
+
+// Data Sources
+#include <bb/data/JsonDataAccess>
+
+using namespace bb::data;
+
+
+/*
+ * Runs the emulator without any Cascades UI, Screen window or
+ * QSA device. The frame buffer is a plain heap allocation and
+ * audio is pulled into a local buffer.
+ *
+ * Replay mode:
+ *
+ *     Mark_V --replay replays.json [--record] [--threshold 10] [--trace trace.json] [--threaded-render]
+ *
+ * The manifest is an array of replays:
+ *
+ * [
+ *     {
+ *         "name": "sonic_1",
+ *         "rom": "replays/sonic.bin",
+ *         "movie": "replays/sonic_1.inp",
+ *         "baseline": "replays/sonic_1.json"
+ *     },
+ *     ...
+ * ]
+ *
+ * movie: raw little endian 16 bit words, one per frame, holding
+ *        the INPUT_* bits of pad 0 for that frame.
+ * baseline: written by --record. Contains the CRC of every frame's
+ *           visible area, the CRC of every frame's audio block and
+ *           the median emulation time per frame in microseconds.
+ *
+ * A replay fails if any frame or audio hash differs from its baseline
+ * or if the median frame time is slower than the baseline by more than
+ * the threshold (in percent). The exit code is the number of failures.
+ * A CONFIG+=markv_profile build also prints each replay's time per
+ * core subsystem (see Profile.hpp).
+ * With --trace the spans of a CONFIG+=trace build are written out as
+ * Chrome trace JSON once all replays have run.
+ * With --threaded-render every frame goes through a FramePipeline the
+ * way a game with settings.threadedRender does, and what is hashed is
+ * the frame as presented, so a baseline recorded without it checks
+ * that the pipeline shows exactly the frames the core drew.
+ *
+ * Thumbnail mode:
+ *
+ *     Mark_V --thumbnails [--frame 1800 | --random 3] [--width 160] [--force]
+ *
+ * Boots every game of data/library.json, runs it to the given frame (or
+ * to a few random frames) and writes data/<gameID>_<n>.png downscaled to
+ * the given width. The core keeps its state in globals so each game is
+ * run by a separate worker process, one per core:
+ *
+ *     Mark_V --thumbnail-worker <rom> <prefix> <width> <frame>...
+ *
+ * Audio filter benchmark:
+ *
+ *     Mark_V --audio-bench [--blocks 10000]
+ *
+ * Runs the AudioFilter chain over a frame's worth of noise at a time,
+ * vector and scalar, and prints the cost per block of each and the
+ * largest difference between their outputs.
+ *
+ * Recording conversion:
+ *
+ *     Mark_V --convert-recording <name>.mkvr <frames>.rgb
+ *
+ * Decodes a SessionRecorder recording to raw RGB565 frames, each the
+ * recorded frame centred in a VIDEO_WIDTH x VIDEO_HEIGHT canvas, and
+ * prints the ffmpeg command that joins them with the recording's WAV.
+ * */
+class HeadlessRunner
+{
+protected:
+    std::vector<uint16_t> frame_buffer;
+    int16_t soundframe[Genesis::SOUND_SAMPLES_SIZE];
+    int samples = 0;
+
+
+    //
+    //
+    void attachBitmap()
+    {
+        frame_buffer.assign(Genesis::VIDEO_WIDTH * Genesis::VIDEO_HEIGHT, 0);
+
+        bitmap.width  = Genesis::VIDEO_WIDTH;
+        bitmap.height = Genesis::VIDEO_HEIGHT;
+        bitmap.pitch  = Genesis::VIDEO_WIDTH * sizeof(uint16_t);
+        bitmap.data   = (uint8 *)frame_buffer.data();
+    }
+
+
+    //
+    //
+    uLong videoHash(const uint8_t *data = bitmap.data) const
+    {
+        uLong crc = crc32(0L, Z_NULL, 0);
+
+        for(int y = bitmap.viewport.y; y < bitmap.viewport.y + bitmap.viewport.h; y++)
+            crc = crc32(crc, data + y * bitmap.pitch + bitmap.viewport.x * sizeof(uint16_t), bitmap.viewport.w * sizeof(uint16_t));
+
+        return crc;
+    }
+
+
+    //
+    //
+    uLong audioHash() const
+    {
+        return crc32(crc32(0L, Z_NULL, 0), (const Bytef *)soundframe, samples * 2 * sizeof(int16_t));
+    }
+
+
+    //
+    //
+    static QString hex(uLong value)
+    {
+        return QString::number( (qulonglong)value, 16 ).toUpper();
+    }
+
+
+    //
+    //
+    static qint64 median(std::vector<qint64> values)
+    {
+        if(values.empty())
+            return 0;
+
+        std::nth_element(values.begin(), values.begin() + values.size() / 2, values.end());
+        return values[values.size() / 2];
+    }
+
+
+    //
+    //
+    static std::vector<uint16_t> loadMovie(const QString &path)
+    {
+        QFile file(path);
+        std::vector<uint16_t> movie;
+
+        if(!file.open(QIODevice::ReadOnly))
+            return movie;
+
+        const QByteArray &data = file.readAll();
+        movie.reserve(data.size() / 2);
+
+        for(int i = 0; i + 1 < data.size(); i += 2)
+            movie.push_back( (uint8_t)data[i] | ((uint8_t)data[i + 1] << 8) );
+
+        return movie;
+    }
+
+
+    /*
+     *      Emulate one frame with the given pad state and pull
+     *      the audio it produced. Returns the emulation time.
+     * */
+    qint64 step(Genesis &genesis, uint16_t pad)
+    {
+        QElapsedTimer timer;
+
+        input.pad[0] = pad;
+
+        timer.start();
+
+        PROFILE_FRAME();
+        genesis.frame();
+        samples = audio_update(soundframe);
+
+        return timer.nsecsElapsed() / 1000;
+    }
+
+
+    //
+    //
+    bool replay(const QVariantMap &test, bool record, double threshold, bool threaded)
+    {
+        const QString &name = test.value("name", QFileInfo(test.value("movie").toString()).baseName()).toString();
+        const auto &movie = loadMovie( test.value("movie").toString() );
+
+        if(movie.empty())
+        {
+            fprintf(stderr, "%s: failed to load movie.\n", name.toAscii().constData());
+            return false;
+        }
+
+        QVariantList video_hashes;
+        QVariantList audio_hashes;
+        std::vector<qint64> frame_times;
+        frame_times.reserve(movie.size());
+
+        {
+            attachBitmap();
+            Genesis genesis(test.value("rom").toString(), nullptr, false);
+            Profile::take();
+
+            FramePipeline pipeline;
+            if(threaded)
+                pipeline.open(bitmap.data, bitmap.pitch, Genesis::VIDEO_HEIGHT);
+
+            for(const auto pad : movie)
+            {
+                if(threaded)
+                    bitmap.data = pipeline.draw();
+
+                frame_times.push_back( step(genesis, pad) );
+
+                if(threaded)
+                {
+                    pipeline.finish();
+                    pipeline.present( (uint8_t *)frame_buffer.data() );
+                }
+
+                video_hashes << hex( videoHash( threaded ? (const uint8_t *)frame_buffer.data() : bitmap.data ) );
+                audio_hashes << hex( audioHash() );
+            }
+
+            bitmap.data = (uint8 *)frame_buffer.data();
+        }
+
+#ifdef MARKV_PROFILE
+        printf("PROFILE %s: %s\n", name.toAscii().constData(), qPrintable( Profile::report( Profile::take() ) ));
+#endif
+
+        JsonDataAccess jda;
+        const QString &baseline_file = test.value("baseline").toString();
+
+        if(record)
+        {
+            QVariantMap baseline;
+            baseline["frames"] = (int)movie.size();
+            baseline["video"]  = video_hashes;
+            baseline["audio"]  = audio_hashes;
+            baseline["medianFrameTime"] = median(frame_times);
+
+            jda.save(baseline, baseline_file);
+            printf("RECORD %s: %d frames, median %lldus\n", name.toAscii().constData(), (int)movie.size(), median(frame_times));
+            return !jda.hasError();
+        }
+
+        const auto &baseline = jda.load(baseline_file).toMap();
+        if(jda.hasError())
+        {
+            fprintf(stderr, "FAIL %s: no baseline at %s.\n", name.toAscii().constData(), baseline_file.toAscii().constData());
+            return false;
+        }
+
+        const auto &expected_video = baseline.value("video").toList();
+        const auto &expected_audio = baseline.value("audio").toList();
+
+        if(expected_video.size() != video_hashes.size() || expected_audio.size() != audio_hashes.size())
+        {
+            fprintf(stderr, "FAIL %s: baseline has %d frames, replay has %d.\n", name.toAscii().constData(), expected_video.size(), video_hashes.size());
+            return false;
+        }
+
+        for(int i = 0; i < video_hashes.size(); i++)
+        {
+            if(expected_video[i] != video_hashes[i])
+            {
+                fprintf(stderr, "FAIL %s: frame %d video hash %s, expected %s.\n", name.toAscii().constData(), i,
+                        video_hashes[i].toString().toAscii().constData(), expected_video[i].toString().toAscii().constData());
+                return false;
+            }
+
+            if(expected_audio[i] != audio_hashes[i])
+            {
+                fprintf(stderr, "FAIL %s: frame %d audio hash %s, expected %s.\n", name.toAscii().constData(), i,
+                        audio_hashes[i].toString().toAscii().constData(), expected_audio[i].toString().toAscii().constData());
+                return false;
+            }
+        }
+
+        const qint64 expected_time = baseline.value("medianFrameTime").toLongLong();
+        const qint64 frame_time = median(frame_times);
+
+        if(expected_time > 0 && frame_time > expected_time * (1.0 + threshold / 100.0))
+        {
+            fprintf(stderr, "FAIL %s: median frame time %lldus, baseline %lldus (+%.1f%% allowed).\n",
+                    name.toAscii().constData(), frame_time, expected_time, threshold);
+            return false;
+        }
+
+        printf("PASS %s: %d frames, median %lldus (baseline %lldus)\n", name.toAscii().constData(), video_hashes.size(), frame_time, expected_time);
+        return true;
+    }
+
+
+    /*
+     *      Worker side of thumbnail mode. Frames must be ascending.
+     * */
+    int thumbnailWorker(const QStringList &args)
+    {
+        const QString &rom = args.value(0);
+        const QString &prefix = args.value(1);
+        const int width = args.value(2).toInt();
+
+        attachBitmap();
+        Genesis genesis(rom, nullptr, false);
+
+        int frame = 0;
+        for(int i = 3; i < args.size(); i++)
+        {
+            for(const int target = args[i].toInt(); frame < target; frame++)
+                step(genesis, 0);
+
+            const QImage img( bitmap.data + bitmap.viewport.y * bitmap.pitch + bitmap.viewport.x * sizeof(uint16_t),
+                              bitmap.viewport.w, bitmap.viewport.h, bitmap.pitch, QImage::Format_RGB16 );
+
+            if( !img.convertToFormat(QImage::Format_RGB888)
+                    .scaledToWidth(width, Qt::SmoothTransformation)
+                    .save(prefix + "_" + QString::number(i - 3) + ".png", "png") )
+                return 1;
+        }
+
+        return 0;
+    }
+
+
+    //
+    //
+    int audioBench(const QStringList &args)
+    {
+        const int at = args.indexOf("--blocks");
+        const int blocks = (at > 0 && at + 1 < args.size()) ? args[at + 1].toInt() : 10000;
+        const int frames = Genesis::SOUND_FREQUENCY / 60;
+
+        QVariantMap settings;
+        settings["volume"]  = 0.8;
+        settings["lowPass"] = 0.7;
+        settings["width"]   = 1.5;
+
+        AudioFilter vector, scalar;
+        vector.configure(settings);
+        scalar.configure(settings);
+        scalar.setVectorized(false);
+
+        std::vector<int16_t> a(frames * 2), b(frames * 2);
+        int difference = 0;
+
+        for(int block = 0; block < blocks; block++)
+        {
+            for(int i = 0; i < frames * 2; i++)
+                a[i] = b[i] = (qrand() % 60000) - 30000 + 500;
+
+            vector.process(a.data(), frames);
+            scalar.process(b.data(), frames);
+
+            for(int i = 0; i < frames * 2; i++)
+                difference = qMax(difference, qAbs(a[i] - b[i]));
+        }
+
+        const auto &fast = vector.take();
+        const auto &slow = scalar.take();
+
+        printf("AUDIO %d frames per block: vector %lldns (worst %lldns), scalar %lldns (worst %lldns), outputs differ by up to %d\n",
+               frames, fast.mean, fast.worst, slow.mean, slow.worst, difference);
+        return 0;
+    }
+
+
+    //
+    //
+    int convertRecording(const QStringList &args)
+    {
+        SessionRecorder::Reader reader( args.value(0) );
+        QFile out( args.value(1) );
+
+        if(!reader.isValid() || !out.open(QIODevice::WriteOnly | QIODevice::Truncate))
+        {
+            fprintf(stderr, "usage: --convert-recording <recording.mkvr> <frames.rgb>\n");
+            return -1;
+        }
+
+        const int row = Genesis::VIDEO_WIDTH * sizeof(uint16_t);
+        QByteArray canvas(row * Genesis::VIDEO_HEIGHT, 0);
+        QByteArray pixels;
+        int width, height, frames = 0;
+
+        while(reader.read(&pixels, &width, &height))
+        {
+            const int w = qMin<int>(width, Genesis::VIDEO_WIDTH);
+            const int h = qMin<int>(height, Genesis::VIDEO_HEIGHT);
+            const int x = (Genesis::VIDEO_WIDTH - w) / 2;
+            const int y = (Genesis::VIDEO_HEIGHT - h) / 2;
+
+            canvas.fill(0);
+
+            for(int line = 0; line < h; line++)
+                memcpy(canvas.data() + (y + line) * row + x * sizeof(uint16_t), pixels.constData() + line * width * sizeof(uint16_t), w * sizeof(uint16_t));
+
+            out.write(canvas);
+            frames++;
+        }
+
+        QString wav = args.value(0);
+        wav.replace(QRegExp("\\.mkvr$"), ".wav");
+
+        printf("%d frames at %.3f fps.\n", frames, reader.frame_rate);
+        printf("ffmpeg -f rawvideo -pixel_format rgb565le -video_size %dx%d -framerate %.3f -i %s -i %s -c:v ffv1 -c:a flac out.mkv\n",
+               Genesis::VIDEO_WIDTH, Genesis::VIDEO_HEIGHT, reader.frame_rate,
+               args.value(1).toAscii().constData(), wav.toAscii().constData());
+        return 0;
+    }
+
+
+    /*
+     *      Master side of thumbnail mode. Keeps one worker
+     *      process per core busy until every game is done.
+     * */
+    int thumbnails(const QStringList &args)
+    {
+        const auto option = [&args](const QString &name, int fallback) {
+            const int at = args.indexOf(name);
+            return (at > 0 && at + 1 < args.size()) ? args[at + 1].toInt() : fallback;
+        };
+
+        const int frame  = option("--frame", 1800);
+        const int random = option("--random", 0);
+        const int width  = option("--width", Genesis::VIDEO_WIDTH / 2);
+        const bool force = args.contains("--force");
+
+        JsonDataAccess jda;
+        const auto &library = jda.load("data/library.json").toList();
+
+        if(jda.hasError())
+        {
+            fprintf(stderr, "failed to load data/library.json.\n");
+            return -1;
+        }
+
+        QStringList pending;
+        for(const auto &game : library)
+        {
+            const QString &id = game.toMap().value("gameID").toString();
+
+            if(!id.isEmpty() && (force || !QFileInfo("data/" + id + "_0.png").exists()))
+                pending << id;
+        }
+
+        QElapsedTimer timer;
+        QEventLoop loop;
+        QList<QProcess*> workers;
+        const int total = pending.size();
+        int failures = 0;
+        int done = 0;
+
+        timer.start();
+
+        while(!pending.isEmpty() || !workers.isEmpty())
+        {
+            while(!pending.isEmpty() && workers.size() < qMax(1, QThread::idealThreadCount()))
+            {
+                const QString id = pending.takeFirst();
+
+                QStringList worker_args;
+                worker_args << "--thumbnail-worker" << "data/" + id + ".bin" << "data/" + id << QString::number(width);
+
+                if(random > 0)
+                {
+                    /* Random but reproducible per game. */
+                    qsrand( qHash(id) );
+
+                    QList<int> frames;
+                    for(int i = 0; i < random; i++)
+                        frames << 600 + qrand() % qMax(1, frame);
+
+                    qSort(frames);
+                    for(const int f : frames)
+                        worker_args << QString::number(f);
+                }
+                else
+                {
+                    worker_args << QString::number(frame);
+                }
+
+                QProcess *worker = new QProcess;
+                worker->setProcessChannelMode(QProcess::ForwardedChannels);
+                worker->setProperty("gameID", id);
+                loop.connect(worker, SIGNAL(finished(int, QProcess::ExitStatus)), SLOT(quit()));
+                loop.connect(worker, SIGNAL(error(QProcess::ProcessError)), SLOT(quit()));
+                worker->start(QCoreApplication::applicationFilePath(), worker_args);
+                workers << worker;
+            }
+
+            loop.exec();
+
+            for(auto it = workers.begin(); it != workers.end(); )
+            {
+                QProcess *worker = *it;
+
+                if(worker->state() != QProcess::NotRunning)
+                {
+                    ++it;
+                    continue;
+                }
+
+                // One that never started reports a normal exit with code 0.
+                if(worker->error() == QProcess::FailedToStart || worker->exitStatus() != QProcess::NormalExit || worker->exitCode() != 0)
+                {
+                    fprintf(stderr, "failed %s.\n", worker->property("gameID").toString().toAscii().constData());
+                    failures++;
+                }
+
+                printf("[%d/%d] %s\n", ++done, total, worker->property("gameID").toString().toAscii().constData());
+                fflush(stdout);
+
+                it = workers.erase(it);
+                delete worker;
+            }
+        }
+
+        printf("%d games in %.1fs, %d failed.\n", total, timer.elapsed() / 1000.0, failures);
+        return failures;
+    }
+
+
+public:
+    static bool handles(const QStringList &args)
+    {
+        return args.contains("--replay") || args.contains("--thumbnails") || args.contains("--thumbnail-worker") || args.contains("--audio-bench") || args.contains("--convert-recording");
+    }
+
+
+    //
+    //
+    int exec(const QStringList &args)
+    {
+        if(args.contains("--thumbnail-worker"))
+            return thumbnailWorker( args.mid(args.indexOf("--thumbnail-worker") + 1) );
+
+        if(args.contains("--thumbnails"))
+            return thumbnails(args);
+
+        if(args.contains("--audio-bench"))
+            return audioBench(args);
+
+        if(args.contains("--convert-recording"))
+            return convertRecording( args.mid(args.indexOf("--convert-recording") + 1) );
+
+        const bool record = args.contains("--record");
+        const int threshold_at = args.indexOf("--threshold");
+        const double threshold = (threshold_at > 0 && threshold_at + 1 < args.size()) ? args[threshold_at + 1].toDouble() : 10.0;
+        const int manifest_at = args.indexOf("--replay");
+
+        if(manifest_at + 1 >= args.size())
+        {
+            fprintf(stderr, "usage: %s --replay <manifest.json> [--record] [--threshold <percent>] [--trace <file>] [--threaded-render]\n", args[0].toAscii().constData());
+            return -1;
+        }
+
+        JsonDataAccess jda;
+        const auto &manifest = jda.load( args[manifest_at + 1] ).toList();
+
+        if(jda.hasError())
+        {
+            fprintf(stderr, "failed to load %s.\n", args[manifest_at + 1].toAscii().constData());
+            return -1;
+        }
+
+        int failures = 0;
+        for(const auto &test : manifest)
+        {
+            if(!replay(test.toMap(), record, threshold, args.contains("--threaded-render")))
+                failures++;
+        }
+
+        const int trace_at = args.indexOf("--trace");
+        if(trace_at > 0 && trace_at + 1 < args.size() && !Trace::dump(args[trace_at + 1]))
+            fprintf(stderr, "failed to write %s.\n", args[trace_at + 1].toAscii().constData());
+
+        fflush(stdout);
+        fflush(stderr);
+        return failures;
+    }
+};
@@ -0,0 +1,797 @@
+/*
+ * ImportPipeline.hpp
+ *
+ *  Created on: Oct 19, 2026
+ *      Author: swatson
+ */
+
+#pragma once
+
+#include "Trace.hpp"
+#include "ZipReader.hpp"
+
+
+#include <zlib.h>
+#include <dirent.h>
+#include <sys/stat.h>
+
+#include <vector>
+#include <cstring>
+#include <functional>
+
+
+#include <QFile>
+#include <QSet>
+#include <QHash>
+#include <QPair>
+#include <QImage>
+#include <QMutex>
+#include <QQueue>
+#include <QThread>
+#include <QObject>
+#include <QFileInfo>
+#include <QEventLoop>
+#include <QStringList>
+#include <QElapsedTimer>
+#include <QWaitCondition>
+#include <QScopedPointer>
+#include <QNetworkReply>
+#include <QNetworkRequest>
+#include <QNetworkAccessManager>
+
+// Data Sources
+#include <bb/data/JsonDataAccess>
+
+using namespace bb::data;
+
+
+/*
+ * A fixed capacity queue between two pipeline stages. push()
+ * blocks while the queue is full so a fast stage can't run
+ * ahead of a slow one. Both ends return false once the queue
+ * is aborted, or for pop() once it is closed and drained.
+ * */
+template<class T>
+class BoundedQueue
+{
+    QMutex mutex;
+    QWaitCondition not_empty;
+    QWaitCondition not_full;
+    QQueue<T> queue;
+    const int capacity;
+    bool closed = false;
+    bool aborted = false;
+
+public:
+    explicit BoundedQueue(int capacity): capacity(capacity) {}
+
+
+    bool push(const T &item)
+    {
+        QMutexLocker lk(&mutex);
+
+        while(queue.size() >= capacity && !aborted)
+            not_full.wait(&mutex);
+
+        if(aborted)
+            return false;
+
+        queue.enqueue(item);
+        not_empty.wakeOne();
+        return true;
+    }
+
+
+    bool pop(T &item)
+    {
+        QMutexLocker lk(&mutex);
+
+        while(queue.isEmpty() && !closed && !aborted)
+            not_empty.wait(&mutex);
+
+        if(aborted || queue.isEmpty())
+            return false;
+
+        item = queue.dequeue();
+        not_full.wakeOne();
+        return true;
+    }
+
+
+    /* No more items will be pushed. */
+    void close()
+    {
+        QMutexLocker lk(&mutex);
+        closed = true;
+        not_empty.wakeAll();
+    }
+
+
+    /* Drop everything and release all waiters. */
+    void abort()
+    {
+        QMutexLocker lk(&mutex);
+        aborted = true;
+        queue.clear();
+        not_empty.wakeAll();
+        not_full.wakeAll();
+    }
+};
+
+
+
+/*
+ * Imports ROM files in stages connected by bounded queues:
+ *
+ *     enumerate -> read+hash -> catalog match -> place file -> persist -> art fetch
+ *
+ * Folders are walked one directory entry at a time while the rest
+ * of the pipeline runs, so a large tree is never listed up front.
+ * Members of zip archives are hashed straight from the inflate
+ * stream and only the ones found in the catalog are extracted.
+ *
+ * Each stage has its own worker threads sized for the kind of work
+ * it does. Disk stages get one or two workers so they don't fight
+ * over the same device, network gets several. Every stage keeps a
+ * count of items and busy time for a throughput report.
+ *
+ * The pipeline never touches the UI. It reports through signals
+ * which are delivered on the thread it lives in:
+ *
+ *     queued    - a file was opened, show a placeholder for it.
+ *     dropped   - the file could not be imported.
+ *     persisted - the library entry for the file.
+ *     artFetched - box art for an imported game was downloaded.
+ *     progress  - files done of the total, which is 0 (unknown)
+ *                 until every file has been enumerated.
+ * */
+class ImportPipeline: public QObject
+{
+    Q_OBJECT
+
+public:
+    struct Job
+    {
+        int id;
+        QString path;
+        QByteArray data;
+        QString crc;
+        QVariantMap found;
+        bool archived;
+        ZipReader::Member member;
+    };
+
+private:
+    class Worker: public QThread
+    {
+        std::function<void()> body;
+
+        void run() override
+        {
+            body();
+        }
+
+    public:
+        Worker(const std::function<void()> &body, QObject *parent): QThread(parent), body(body) {}
+    };
+
+    struct Stage
+    {
+        QString name;
+        int workers;
+        int running;
+        int items;
+        qint64 busy;
+    };
+
+    enum { ENUMERATE, READ_HASH, MATCH, PLACE, PERSIST, ART_FETCH, STAGES };
+
+    QMutex mutex;
+    Stage stages[STAGES];
+    QList<Worker*> threads;
+    QElapsedTimer wall;
+
+    BoundedQueue<Job> hash_queue    { 4 };
+    BoundedQueue<Job> match_queue   { 4 };
+    BoundedQueue<Job> place_queue   { 4 };
+    BoundedQueue<Job> persist_queue { 8 };
+    BoundedQueue<Job> art_queue     { 64 };
+
+    const QStringList files;
+    QAtomicInt cancelled;
+    int total = 0;
+    int done = 0;
+    int next_id = 0;
+    bool enumerated = false;
+
+
+    void account(int stage, qint64 ns)
+    {
+        static const char *const trace_names[STAGES] = { "import: enumerate", "import: read+hash", "import: match",
+                                                         "import: place", "import: persist", "import: art fetch" };
+        TRACE_COMPLETE(trace_names[stage], ns);
+        Q_UNUSED(trace_names);
+
+        QMutexLocker lk(&mutex);
+        stages[stage].items++;
+        stages[stage].busy += ns;
+    }
+
+
+    void complete()
+    {
+        int done, total;
+
+        {
+            QMutexLocker lk(&mutex);
+            done = ++this->done;
+            total = enumerated ? this->total : 0;
+        }
+
+        emit progress(done, total);
+    }
+
+
+    /* Every file is known; the total stops moving. */
+    void enumerationDone()
+    {
+        int done, total;
+
+        {
+            QMutexLocker lk(&mutex);
+            enumerated = true;
+            done = this->done;
+            total = this->total;
+        }
+
+        emit progress(done, total);
+    }
+
+
+    /*
+     *      Start a stage. When its last worker returns the
+     *      queue it feeds is closed so the next stage drains.
+     * */
+    void spawn(int stage, const QString &name, int workers, BoundedQueue<Job> *downstream, const std::function<void()> &body)
+    {
+        stages[stage].name = name;
+        stages[stage].workers = workers;
+        stages[stage].running = workers;
+        stages[stage].items = 0;
+        stages[stage].busy = 0;
+
+        for(int i = 0; i < workers; i++)
+        {
+            Worker *worker = new Worker([this, stage, downstream, body]() {
+                body();
+
+                QMutexLocker lk(&mutex);
+                if(--stages[stage].running == 0)
+                {
+                    if(downstream)
+                        downstream->close();
+
+                    if(stage == ART_FETCH)
+                        QMetaObject::invokeMethod(this, "onDrained", Qt::QueuedConnection);
+                }
+            }, this);
+
+            worker->setObjectName(name);
+            threads << worker;
+        }
+    }
+
+
+    Q_SLOT void onDrained()
+    {
+        for(auto *thread : threads)
+            thread->wait();
+
+        // Let signals the workers sent before exiting arrive first.
+        QMetaObject::invokeMethod(this, "onFinished", Qt::QueuedConnection);
+    }
+
+
+    Q_SLOT void onFinished()
+    {
+        qDebug() << qPrintable( report() );
+        emit finished(cancelled);
+    }
+
+
+    static bool isRom(const QString &name)
+    {
+        static const QStringList extensions = QStringList() << "bin" << "md" << "gen" << "smd" << "sms" << "gg" << "sg";
+
+        return extensions.contains( QFileInfo(name).suffix().toLower() );
+    }
+
+
+    static bool isArchive(const QString &name)
+    {
+        return QFileInfo(name).suffix().toLower() == "zip";
+    }
+
+
+    bool offer(const Job &job)
+    {
+        Job numbered = job;
+
+        {
+            QMutexLocker lk(&mutex);
+            numbered.id = next_id++;
+            total++;
+        }
+
+        return hash_queue.push(numbered);
+    }
+
+
+    /*
+     *      Queue a file, or the ROMs inside it if it's an archive.
+     * */
+    bool offerFile(const QString &path)
+    {
+        Job job;
+        job.path = path;
+        job.archived = false;
+
+        if(!isArchive(path))
+            return offer(job);
+
+        job.archived = true;
+
+        for(const auto &member : ZipReader::members(path))
+        {
+            if(cancelled)
+                return false;
+
+            if(!isRom(member.name))
+                continue;
+
+            job.member = member;
+            if(!offer(job))
+                return false;
+        }
+
+        return true;
+    }
+
+
+    /*
+     *      Depth first walk holding one open handle per level.
+     *      Links are followed, but each directory is only entered
+     *      once so a link back up the tree can't loop forever.
+     * */
+    bool walk(const QString &root)
+    {
+        std::vector<std::pair<DIR*, QByteArray>> stack;
+        QSet<QPair<quint64, quint64>> visited;
+        bool ok = true;
+        struct stat info;
+
+        if(stat(QFile::encodeName(root).constData(), &info))
+            return true;
+
+        visited.insert( qMakePair((quint64)info.st_dev, (quint64)info.st_ino) );
+
+        if(DIR *dir = opendir( QFile::encodeName(root).constData() ))
+            stack.push_back( std::make_pair(dir, QFile::encodeName(root)) );
+
+        while(!stack.empty())
+        {
+            if(cancelled)
+            {
+                ok = false;
+                break;
+            }
+
+            QElapsedTimer timer;
+            timer.start();
+
+            dirent *entry = readdir(stack.back().first);
+
+            if(!entry)
+            {
+                closedir(stack.back().first);
+                stack.pop_back();
+                continue;
+            }
+
+            if(!strcmp(entry->d_name, ".") || !strcmp(entry->d_name, ".."))
+                continue;
+
+            const QByteArray path = stack.back().second + "/" + entry->d_name;
+
+            if(stat(path.constData(), &info))
+                continue;
+
+            if(S_ISDIR(info.st_mode))
+            {
+                const auto &id = qMakePair((quint64)info.st_dev, (quint64)info.st_ino);
+
+                if(visited.contains(id))
+                    continue;
+
+                visited.insert(id);
+
+                if(DIR *dir = opendir(path.constData()))
+                    stack.push_back( std::make_pair(dir, path) );
+            }
+            else if(S_ISREG(info.st_mode))
+            {
+                const QString &name = QFile::decodeName(path);
+
+                account(ENUMERATE, timer.nsecsElapsed());
+
+                if((isRom(name) || isArchive(name)) && !offerFile(name))
+                {
+                    ok = false;
+                    break;
+                }
+            }
+        }
+
+        for(const auto &level : stack)
+            closedir(level.first);
+
+        return ok;
+    }
+
+
+    /*
+     *      Stages
+     * */
+    void enumerate()
+    {
+        for(const auto &path : files)
+        {
+            if(cancelled)
+                return;
+
+            if(QFileInfo(path).isDir())
+            {
+                if(!walk(path))
+                    return;
+
+                continue;
+            }
+
+            QElapsedTimer timer;
+            timer.start();
+
+            const bool ok = offerFile(path);
+
+            account(ENUMERATE, timer.nsecsElapsed());
+
+            if(!ok)
+                return;
+        }
+    }
+
+
+    void readHash()
+    {
+        Job job;
+
+        while(hash_queue.pop(job))
+        {
+            QElapsedTimer timer;
+            timer.start();
+
+            if(job.archived)
+            {
+                emit queued(job.id);
+
+                // Only the CRC is kept; matched members are extracted later.
+                uLong crc = crc32(0L, Z_NULL, 0);
+                const bool ok = ZipReader::extract(job.path, job.member, [this, &crc](const char *data, int size) {
+                    crc = crc32(crc, (const Bytef *)data, size);
+                    return !cancelled;
+                });
+
+                if(!ok)
+                {
+                    if(cancelled)
+                        return;
+
+                    qWarning() << "readHash:" << job.path << job.member.name << "is damaged";
+
+                    emit dropped(job.id);
+                    complete();
+                    continue;
+                }
+
+                job.crc = QString::number(crc, 16).toUpper();
+
+                account(READ_HASH, timer.nsecsElapsed());
+
+                if(!match_queue.push(job))
+                    return;
+
+                continue;
+            }
+
+            QFile rom_file(job.path);
+
+            if(!rom_file.open(QIODevice::ReadOnly))
+            {
+                if(rom_file.error() == QFile::PermissionsError)
+                {
+                    qWarning() << "readHash:" << job.path << rom_file.errorString();
+                    qDebug() << "TODO - ask for permission.";
+                }
+
+                complete();
+                continue;
+            }
+
+            emit queued(job.id);
+
+            // Calculate CRC
+            uLong crc = crc32(0L, Z_NULL, 0);
+            job.data.reserve(rom_file.size());
+
+            while(!rom_file.atEnd() && !cancelled)
+            {
+                const QByteArray &chunk = rom_file.read(256 * 1024);
+
+                if(chunk.isEmpty())
+                    break;
+
+                crc = crc32(crc, (const Bytef *)chunk.constData(), chunk.size());
+                job.data += chunk;
+            }
+
+            job.crc = QString::number(crc, 16).toUpper();
+
+            account(READ_HASH, timer.nsecsElapsed());
+
+            if(cancelled || !match_queue.push(job))
+                return;
+        }
+    }
+
+
+    void match()
+    {
+        // Look up by CRC; later catalog entries win like before.
+        QHash<QString, QVariantMap> catalog;
+
+        {
+            JsonDataAccess jda;
+            for(const auto &entry : jda.load("app/native/assets/games.json").toList())
+                catalog.insert(entry.toMap().value("romHashCRC").toString(), entry.toMap());
+        }
+
+        Job job;
+
+        while(match_queue.pop(job))
+        {
+            QElapsedTimer timer;
+            timer.start();
+
+            job.found = catalog.value(job.crc);
+
+            account(MATCH, timer.nsecsElapsed());
+
+            // Archives hold all sorts; only take what we recognise.
+            if(job.archived && job.found.isEmpty())
+            {
+                emit dropped(job.id);
+                complete();
+                continue;
+            }
+
+            if(!place_queue.push(job))
+                return;
+        }
+    }
+
+
+    void place()
+    {
+        Job job;
+
+        while(place_queue.pop(job))
+        {
+            QElapsedTimer timer;
+            timer.start();
+
+            // Files are named by content so an existing copy is the same ROM.
+            QFile dst_file("data/" + job.crc + ".bin");
+            const qint64 size = job.archived ? job.member.size : job.data.size();
+
+            if(!dst_file.exists() || dst_file.size() != size)
+            {
+                bool written = dst_file.open(QIODevice::WriteOnly | QIODevice::Truncate);
+
+                if(written && job.archived)
+                {
+                    written = ZipReader::extract(job.path, job.member, [&dst_file](const char *data, int size) {
+                        return dst_file.write(data, size) == size;
+                    });
+                }
+                else if(written)
+                {
+                    written = dst_file.write(job.data) == job.data.size();
+                }
+
+                if(!written)
+                {
+                    dst_file.remove();
+                    qWarning() << "place:" << dst_file.fileName() << dst_file.errorString();
+
+                    emit dropped(job.id);
+                    complete();
+                    continue;
+                }
+            }
+
+            job.data.clear();
+
+            account(PLACE, timer.nsecsElapsed());
+
+            if(!persist_queue.push(job))
+                return;
+        }
+    }
+
+
+    void persist()
+    {
+        Job job;
+
+        while(persist_queue.pop(job))
+        {
+            QElapsedTimer timer;
+            timer.start();
+
+            QVariantMap settings;
+            settings["title"] = !QFileInfo("data/" + job.crc + ".img").exists();
+
+            QVariantMap entry;
+            entry["gameID"] = job.crc;
+            entry["title"]  = job.found.contains("releaseTitleName") ? job.found.value("releaseTitleName").toString() : "";
+            entry["settings"] = settings;
+
+            emit persisted(job.id, entry);
+
+            account(PERSIST, timer.nsecsElapsed());
+
+            if(job.found.contains("releaseCoverFront") && !QFileInfo("data/" + job.crc + ".img").exists())
+            {
+                if(!art_queue.push(job))
+                    return;
+            }
+            else
+            {
+                complete();
+            }
+        }
+    }
+
+
+    void fetchArt()
+    {
+        QScopedPointer<QNetworkAccessManager> manager( new QNetworkAccessManager );
+        Job job;
+
+        while(art_queue.pop(job))
+        {
+            QElapsedTimer timer;
+            timer.start();
+
+            QScopedPointer<QNetworkReply> reply( manager->get( QNetworkRequest( job.found.value("releaseCoverFront").toUrl() ) ) );
+
+            QEventLoop loop;
+            loop.connect( this, SIGNAL(canceled()), SLOT(quit()) );
+            loop.connect( reply.data(), SIGNAL(finished()), SLOT(quit()) );
+
+            if(!cancelled && !reply->isFinished())
+                loop.exec();
+
+            if(reply->isFinished() && reply->error() == QNetworkReply::NoError)
+            {
+                QImage img;
+                img.loadFromData( reply->readAll() );
+
+                if(img.scaledToWidth(100, Qt::SmoothTransformation).save( "data/" + job.crc + ".img", "png" ))
+                    emit artFetched(job.crc);
+            }
+
+            account(ART_FETCH, timer.nsecsElapsed());
+            complete();
+
+            if(cancelled)
+                return;
+        }
+    }
+
+
+public:
+    ImportPipeline(const QStringList &files, QObject *parent = nullptr): QObject(parent), files(files)
+    {
+        spawn(ENUMERATE, "enumerate", 1, &hash_queue,    [this]() { enumerate(); enumerationDone(); });
+        spawn(READ_HASH, "read+hash", 2, &match_queue,   [this]() { readHash(); });
+        spawn(MATCH,     "match",     1, &place_queue,   [this]() { match(); });
+        spawn(PLACE,     "place",     1, &persist_queue, [this]() { place(); });
+        spawn(PERSIST,   "persist",   1, &art_queue,     [this]() { persist(); });
+        spawn(ART_FETCH, "art fetch", 4, nullptr,        [this]() { fetchArt(); });
+    }
+
+
+    ~ImportPipeline()
+    {
+        cancel();
+
+        for(auto *thread : threads)
+            thread->wait();
+    }
+
+
+    //
+    //
+    void start()
+    {
+        wall.start();
+
+        for(auto *thread : threads)
+            thread->start(QThread::LowPriority);
+    }
+
+
+    /*
+     *      Stop promptly. Work in flight is dropped; files already
+     *      placed stay and their entries may still be persisted.
+     * */
+    Q_SLOT void cancel()
+    {
+        if(cancelled.fetchAndStoreOrdered(1))
+            return;
+
+        hash_queue.abort();
+        match_queue.abort();
+        place_queue.abort();
+        persist_queue.abort();
+        art_queue.abort();
+
+        emit canceled();
+    }
+
+
+    bool isCanceled() const { return cancelled; }
+
+
+    /*
+     *      Items and throughput per stage.
+     * */
+    QString report()
+    {
+        QMutexLocker lk(&mutex);
+        const double seconds = qMax<qint64>(1, wall.elapsed()) / 1000.0;
+        QString text = QString("import: %1 files in %2s").arg(total).arg(seconds, 0, 'f', 2);
+
+        for(const auto &stage : stages)
+        {
+            text += QString("\n    %1 x%2: %3 items, %4 items/s, busy %5ms")
+                        .arg(stage.name, -10)
+                        .arg(stage.workers)
+                        .arg(stage.items)
+                        .arg(stage.items / seconds, 0, 'f', 1)
+                        .arg(stage.busy / 1000000);
+        }
+
+        return text;
+    }
+
+
+Q_SIGNALS:
+    void queued(int job);
+    void dropped(int job);
+    void persisted(int job, const QVariantMap &entry);
+    void artFetched(const QString &gameID);
+    void progress(int done, int total);
+    void canceled();
+    void finished(bool canceled);
+};
@@ -0,0 +1,909 @@
+/*
+ * LibraryDataModel.hpp
+ *
+ *  Created on: Oct 19, 2026
+ *      Author: swatson
+ */
+
+#pragma once
+
+#include <functional>
+
+
+#include <QFile>
+#include <QSet>
+#include <QHash>
+#include <QList>
+#include <QMutex>
+#include <QTimer>
+#include <QVector>
+#include <QObject>
+#include <QVariant>
+#include <QSharedPointer>
+#include <QFutureWatcher>
+#include <QtConcurrentRun>
+
+// Data Sources
+#include <bb/data/JsonDataAccess>
+
+// Data Models
+#include <bb/cascades/DataModel>
+
+using namespace bb::data;
+using namespace bb::cascades;
+
+
+/*
+ * A flat data model over data/library.json that does not parse
+ * the whole library before the UI can be drawn.
+ *
+ * load() splits the top level array into one raw JSON slice per
+ * game on a background thread. Entries are only parsed into a
+ * QVariantMap when the ListView asks for them, a page at a time
+ * and again on a background thread. Until its page is parsed an
+ * entry is reported as an empty map, which the item providers
+ * show as a skeleton item.
+ *
+ * The mutators mirror ArrayDataModel and must be called from the
+ * thread the model lives in. The post*() functions may be called
+ * from any thread; they are queued and applied together every
+ * BATCH_INTERVAL ms so that a burst of changes, like an import,
+ * costs the ListView one layout pass instead of one per change.
+ * Queued changes refer to rows by a ticket given when the row
+ * was posted since row numbers are not known until they apply.
+ * */
+class LibraryDataModel: public DataModel
+{
+    Q_OBJECT
+
+    static constexpr auto PAGE_SIZE = 32;
+    static constexpr auto BATCH_INTERVAL = 100;
+
+    struct Item
+    {
+        QByteArray raw;
+        QVariantMap map;
+        QString id;
+        bool parsed;
+        int ticket;
+    };
+
+    struct Change
+    {
+        enum Type { Append, Replace, Remove, Edit } type;
+        int ticket;
+        QString gameID;
+        QVariantMap value;
+        std::function<void(QVariantMap&)> edit;
+    };
+
+    /*
+     * Maps rows from before a batch to after it.
+     * */
+    class BatchMapper: public DataModel::IndexMapper
+    {
+        QVector<int> rows;
+
+    public:
+        BatchMapper(const QVector<int> &rows): rows(rows)
+        {
+        }
+
+        bool newIndexPath(QVariantList *pNewIndexPath, int *pReplacementIndex, const QVariantList &oldIndexPath) const override
+        {
+            const int old_row = oldIndexPath.value(0, -1).toInt();
+
+            if(old_row < 0 || old_row >= rows.size())
+                return false;
+
+            if(rows[old_row] < 0)
+            {
+                // Removed; the next surviving row takes its place.
+                *pReplacementIndex = -1;
+                for(int i = old_row + 1; i < rows.size() && *pReplacementIndex < 0; i++)
+                    *pReplacementIndex = rows[i];
+
+                return false;
+            }
+
+            *pNewIndexPath = QVariantList() << rows[old_row];
+            return true;
+        }
+    };
+
+    QList<Item> items;
+    QSet<int> pending_pages;
+    int generation = 0;
+
+    /* gameID to row, rebuilt on demand after rows move. */
+    QHash<QString, int> rows;
+
+    /* Ticket to row for rows that still have one. */
+    QHash<int, int> tickets;
+
+    QMutex changes_mutex;
+    QList<Change> changes;
+    QTimer *batch_timer = new QTimer(this);
+
+
+    /*
+     *      Walks JSON text. Only as strict as it needs to
+     *      be to find the boundaries of well formed input.
+     * */
+    static int skipSpace(const QByteArray &json, int at)
+    {
+        while(at < json.size() && (json[at] == ' ' || json[at] == '\n' || json[at] == '\r' || json[at] == '\t'))
+            at++;
+
+        return at;
+    }
+
+
+    static int skipString(const QByteArray &json, int at)
+    {
+        for(at++; at < json.size(); at++)
+        {
+            if(json[at] == '\\')
+                at++;
+            else if(json[at] == '"')
+                return at + 1;
+        }
+
+        return at;
+    }
+
+
+    static int skipValue(const QByteArray &json, int at)
+    {
+        int depth = 0;
+
+        for(at = skipSpace(json, at); at < json.size(); )
+        {
+            const char c = json[at];
+
+            if(c == '"')
+            {
+                at = skipString(json, at);
+            }
+            else if(c == '{' || c == '[')
+            {
+                depth++;
+                at++;
+            }
+            else if(c == '}' || c == ']')
+            {
+                if(depth == 0)
+                    return at;
+
+                at++;
+                if(--depth == 0)
+                    return at;
+            }
+            else if(c == ',' && depth == 0)
+            {
+                return at;
+            }
+            else
+            {
+                at++;
+            }
+
+            if(depth == 0 && c == '"')
+                return at;
+        }
+
+        return at;
+    }
+
+
+    static QString decodeString(const QByteArray &json, int at, int end)
+    {
+        QByteArray utf8;
+
+        for(at++; at < end - 1; at++)
+        {
+            if(json[at] != '\\')
+            {
+                utf8 += json[at];
+                continue;
+            }
+
+            switch(json[++at])
+            {
+            case 'b': utf8 += '\b'; break;
+            case 'f': utf8 += '\f'; break;
+            case 'n': utf8 += '\n'; break;
+            case 'r': utf8 += '\r'; break;
+            case 't': utf8 += '\t'; break;
+            case 'u':
+                utf8 += QString( QChar( json.mid(at + 1, 4).toUShort(0, 16) ) ).toUtf8();
+                at += 4;
+                break;
+            default: utf8 += json[at]; break;
+            }
+        }
+
+        return QString::fromUtf8(utf8);
+    }
+
+
+public:
+    /*
+     *      Returns the string value of a top level key of a
+     *      JSON object without parsing the rest of it.
+     * */
+    static QString peekString(const QByteArray &object, const QByteArray &key)
+    {
+        int at = skipSpace(object, 0);
+
+        if(at >= object.size() || object[at] != '{')
+            return QString();
+
+        for(at = skipSpace(object, at + 1); at < object.size() && object[at] == '"'; )
+        {
+            const int key_end = skipString(object, at);
+            const bool match = object.mid(at + 1, key_end - at - 2) == key;
+
+            at = skipSpace(object, key_end);
+            if(at >= object.size() || object[at] != ':')
+                break;
+
+            const int value_at = skipSpace(object, at + 1);
+            const int value_end = skipValue(object, value_at);
+
+            if(match)
+                return (value_at < object.size() && object[value_at] == '"') ? decodeString(object, value_at, value_end) : QString();
+
+            at = skipSpace(object, value_end);
+            if(at >= object.size() || object[at] != ',')
+                break;
+
+            at = skipSpace(object, at + 1);
+        }
+
+        return QString();
+    }
+
+
+    /*
+     *      Splits a top level JSON array into one slice per element.
+     * */
+    static QList<QByteArray> split(const QByteArray &json)
+    {
+        QList<QByteArray> slices;
+        int at = skipSpace(json, 0);
+
+        if(at >= json.size() || json[at] != '[')
+            return slices;
+
+        for(at = skipSpace(json, at + 1); at < json.size() && json[at] != ']'; )
+        {
+            const int end = skipValue(json, at);
+
+            if(end <= at)
+                break;
+
+            slices << json.mid(at, end - at);
+
+            at = skipSpace(json, end);
+            if(at < json.size() && json[at] == ',')
+                at = skipSpace(json, at + 1);
+        }
+
+        return slices;
+    }
+
+
+private:
+    static QList<Item> index(const QString &file)
+    {
+        QList<Item> result;
+        QFile json(file);
+
+        if(!json.open(QIODevice::ReadOnly))
+            return result;
+
+        for(const auto &slice : split( json.readAll() ))
+        {
+            Item item;
+            item.raw = slice;
+            item.id = peekString(slice, "gameID");
+            item.parsed = false;
+            item.ticket = 0;
+            result << item;
+        }
+
+        return result;
+    }
+
+
+    static QVariantList parse(const QList<QByteArray> &slices)
+    {
+        QByteArray json("[");
+
+        for(int i = 0; i < slices.size(); i++)
+        {
+            if(i) json += ',';
+            json += slices[i];
+        }
+
+        json += ']';
+
+        JsonDataAccess jda;
+        return jda.loadFromBuffer(json).toList();
+    }
+
+
+    Q_SLOT void onIndexed()
+    {
+        auto *watcher = static_cast<QFutureWatcher<QList<Item>>*>( sender() );
+
+        // Rows appended while the file was being indexed, e.g. by an
+        // import, go after the indexed ones, tickets and all.
+        QList<Item> indexed = watcher->result();
+        QSet<QString> known;
+
+        for(const auto &item : indexed)
+            known.insert(item.id);
+
+        for(int i = 0; i < items.size(); i++)
+            if(!known.contains(gameID(i)))
+                indexed << items[i];
+
+        items.swap(indexed);
+        pending_pages.clear();
+        rows.clear();
+        tickets.clear();
+        generation++;
+        watcher->deleteLater();
+
+        emit itemsChanged( DataModelChangeType::Init );
+        emit loaded();
+    }
+
+
+    Q_SLOT void onPageParsed()
+    {
+        auto *watcher = static_cast<QFutureWatcher<QVariantList>*>( sender() );
+        const int page = watcher->property("page").toInt();
+        const auto &maps = watcher->result();
+
+        watcher->deleteLater();
+
+        // Rows moved while parsing; parse what is there now.
+        if(watcher->property("generation").toInt() != generation)
+            return requestPage(page);
+
+        pending_pages.remove(page);
+
+        for(int i = 0; i < maps.size() && page * PAGE_SIZE + i < items.size(); i++)
+        {
+            Item &item = items[page * PAGE_SIZE + i];
+
+            if(!item.parsed)
+            {
+                item.map = maps[i].toMap();
+                item.raw.clear();
+                item.parsed = true;
+
+                emit itemUpdated( QVariantList() << page * PAGE_SIZE + i );
+            }
+        }
+    }
+
+
+    void requestPage(int page)
+    {
+        if(pending_pages.contains(page))
+            return;
+
+        QList<QByteArray> slices;
+        for(int i = page * PAGE_SIZE; i < qMin(items.size(), (page + 1) * PAGE_SIZE); i++)
+            slices << (items[i].parsed ? QByteArray("{}") : items[i].raw);
+
+        pending_pages.insert(page);
+
+        auto *watcher = new QFutureWatcher<QVariantList>(this);
+        watcher->setProperty("page", page);
+        watcher->setProperty("generation", generation);
+        watcher->connect( watcher, SIGNAL(finished()), this, SLOT(onPageParsed()) );
+        watcher->setFuture( QtConcurrent::run(&LibraryDataModel::parse, slices) );
+    }
+
+
+    Item &materialize(int i)
+    {
+        Item &item = items[i];
+
+        if(!item.parsed)
+        {
+            JsonDataAccess jda;
+            item.map = jda.loadFromBuffer(item.raw).toMap();
+            item.raw.clear();
+            item.parsed = true;
+        }
+
+        return item;
+    }
+
+
+    int ticketRow(int ticket)
+    {
+        if(tickets.isEmpty())
+        {
+            for(int i = 0; i < items.size(); i++)
+                if(items[i].ticket)
+                    tickets.insert(items[i].ticket, i);
+        }
+
+        const int row = tickets.value(ticket, -1);
+
+        return (row >= 0 && row < items.size() && items[row].ticket == ticket) ? row : -1;
+    }
+
+
+    void post(const Change &change)
+    {
+        QMutexLocker lk(&changes_mutex);
+
+        changes << change;
+
+        if(changes.size() == 1)
+            QMetaObject::invokeMethod(batch_timer, "start", Qt::QueuedConnection);
+    }
+
+
+    /*
+     *      Apply every queued change. Rows removed in the batch are
+     *      only marked until the end so the rest never see rows move.
+     * */
+    Q_SLOT void applyChanges()
+    {
+        QList<Change> batch;
+
+        {
+            QMutexLocker lk(&changes_mutex);
+            batch.swap(changes);
+        }
+
+        if(batch.isEmpty())
+            return;
+
+        const int old_count = items.size();
+        QSet<int> updated;
+        QSet<int> removed;
+
+        for(const auto &change : batch)
+        {
+            int row = -1;
+
+            if(change.type == Change::Edit)
+                row = indexOf(change.gameID);
+            else if(change.type != Change::Append)
+                row = ticketRow(change.ticket);
+
+            switch(change.type)
+            {
+            case Change::Append:
+            {
+                Item item;
+                item.map = change.value;
+                item.parsed = true;
+                item.ticket = change.ticket;
+                items << item;
+                tickets.insert(change.ticket, items.size() - 1);
+
+                // Keep the gameID cache warm; edits in this batch use it.
+                if(!rows.isEmpty())
+                    rows.insert(gameID(items.size() - 1), items.size() - 1);
+                break;
+            }
+            case Change::Replace:
+                if(row < 0)
+                    break;
+
+                items[row].map = change.value;
+                items[row].raw.clear();
+                items[row].parsed = true;
+                items[row].ticket = 0;
+                tickets.remove(change.ticket);
+
+                if(!rows.isEmpty())
+                    rows.insert(gameID(row), row);
+
+                updated.insert(row);
+                break;
+            case Change::Remove:
+                if(row < 0)
+                    break;
+
+                items[row].ticket = 0;
+                tickets.remove(change.ticket);
+                removed.insert(row);
+                break;
+            case Change::Edit:
+                if(row < 0 || removed.contains(row))
+                    break;
+
+                change.edit( materialize(row).map );
+                updated.insert(row);
+                break;
+            }
+        }
+
+        // Compact, remembering where each of the old rows went.
+        QVector<int> moved(old_count, -1);
+
+        if(!removed.isEmpty())
+        {
+            QList<Item> kept;
+            kept.reserve(items.size() - removed.size());
+
+            for(int i = 0; i < items.size(); i++)
+            {
+                if(removed.contains(i))
+                    continue;
+
+                if(i < old_count)
+                    moved[i] = kept.size();
+
+                kept << items[i];
+            }
+
+            items.swap(kept);
+            pending_pages.clear();
+            rows.clear();
+            tickets.clear();
+            generation++;
+        }
+        else
+        {
+            for(int i = 0; i < old_count; i++)
+                moved[i] = i;
+        }
+
+        if(items.size() != old_count || !removed.isEmpty())
+            emit itemsChanged( DataModelChangeType::AddRemove, QSharedPointer<DataModel::IndexMapper>( new BatchMapper(moved) ) );
+
+        // Rows added in this batch were drawn fresh by the AddRemove above.
+        for(const int row : updated)
+            if(row < old_count && moved[row] >= 0)
+                emit itemUpdated( QVariantList() << moved[row] );
+
+        emit batchApplied();
+    }
+
+
+public:
+    LibraryDataModel(QObject *parent = nullptr): DataModel(parent)
+    {
+        batch_timer->setSingleShot(true);
+        batch_timer->setInterval(BATCH_INTERVAL);
+
+        bool connection;
+        connection = connect( batch_timer, SIGNAL(timeout()), this, SLOT(applyChanges()) );
+        Q_ASSERT( connection );
+        Q_UNUSED( connection );
+    }
+
+
+    /*
+     *      Index the library file in the background. The model
+     *      is replaced and itemsChanged emitted when it is done.
+     * */
+    void load(const QString &file)
+    {
+        auto *watcher = new QFutureWatcher<QList<Item>>(this);
+        watcher->connect( watcher, SIGNAL(finished()), this, SLOT(onIndexed()) );
+        watcher->setFuture( QtConcurrent::run(&LibraryDataModel::index, file) );
+    }
+
+
+    /*
+     *      Write the library back out. Entries that were never
+     *      parsed are written as the text they were read from.
+     * */
+    bool save(const QString &file)
+    {
+        JsonDataAccess jda;
+        QByteArray json("[");
+        bool first = true;
+
+        for(const auto &item : items)
+        {
+            QByteArray entry;
+
+            if(!item.parsed)
+                entry = item.raw;
+            else if(!item.map.isEmpty())
+                jda.saveToBuffer(item.map, &entry);
+
+            if(entry.isEmpty())
+                continue;
+
+            json += first ? "\n" : ",\n";
+            json += entry;
+            first = false;
+        }
+
+        json += "\n]\n";
+
+        QFile out(file);
+        return out.open(QIODevice::WriteOnly | QIODevice::Truncate) && out.write(json) == json.size();
+    }
+
+
+    int size() const { return items.size(); }
+    bool isEmpty() const { return items.isEmpty(); }
+
+
+    //
+    //
+    QVariant value(int i)
+    {
+        if(i < 0 || i >= items.size())
+            return QVariant();
+
+        return materialize(i).map;
+    }
+
+
+    /*
+     *      The gameID of an entry, known without parsing it.
+     * */
+    QString gameID(int i) const
+    {
+        if(i < 0 || i >= items.size())
+            return QString();
+
+        return items[i].parsed ? items[i].map.value("gameID").toString() : items[i].id;
+    }
+
+
+    /*
+     *      A top level string of an entry, parsed or not.
+     * */
+    QString peek(int i, const QByteArray &key) const
+    {
+        if(i < 0 || i >= items.size())
+            return QString();
+
+        return items[i].parsed ? items[i].map.value(key).toString() : peekString(items[i].raw, key);
+    }
+
+
+    //
+    //
+    int indexOf(const QString &gameID)
+    {
+        if(rows.isEmpty())
+        {
+            rows.clear();
+            for(int i = 0; i < items.size(); i++)
+                rows.insert(this->gameID(i), i);
+        }
+
+        const int row = rows.value(gameID, -1);
+
+        return (row >= 0 && this->gameID(row) == gameID) ? row : -1;
+    }
+
+
+    //
+    //
+    void append(const QVariant &value)
+    {
+        Item item;
+        item.map = value.toMap();
+        item.parsed = true;
+        item.ticket = 0;
+        items << item;
+        rows.clear();
+
+        emit itemAdded( QVariantList() << items.size() - 1 );
+    }
+
+
+    //
+    //
+    void replace(int i, const QVariant &value)
+    {
+        if(i < 0 || i >= items.size())
+            return;
+
+        items[i].map = value.toMap();
+        items[i].raw.clear();
+        items[i].parsed = true;
+        rows.clear();
+
+        emit itemUpdated( QVariantList() << i );
+    }
+
+
+    //
+    //
+    void removeAt(int i)
+    {
+        if(i < 0 || i >= items.size())
+            return;
+
+        items.removeAt(i);
+        pending_pages.clear();
+        rows.clear();
+        tickets.clear();
+        generation++;
+
+        emit itemRemoved( QVariantList() << i );
+    }
+
+
+    /*
+     *      Queue a new row at the end, known by ticket until it is
+     *      replaced or removed. Tickets must be non zero and unique.
+     * */
+    void postAppend(int ticket, const QVariantMap &value)
+    {
+        Change change;
+        change.type = Change::Append;
+        change.ticket = ticket;
+        change.value = value;
+        post(change);
+    }
+
+
+    //
+    //
+    void postReplace(int ticket, const QVariantMap &value)
+    {
+        Change change;
+        change.type = Change::Replace;
+        change.ticket = ticket;
+        change.value = value;
+        post(change);
+    }
+
+
+    //
+    //
+    void postRemove(int ticket)
+    {
+        Change change;
+        change.type = Change::Remove;
+        change.ticket = ticket;
+        post(change);
+    }
+
+
+    /*
+     *      Queue an edit of a game's entry. edit runs on the
+     *      model's thread when the batch is applied.
+     * */
+    void postEdit(const QString &gameID, const std::function<void(QVariantMap&)> &edit)
+    {
+        Change change;
+        change.type = Change::Edit;
+        change.ticket = 0;
+        change.gameID = gameID;
+        change.edit = edit;
+        post(change);
+    }
+
+
+    /*
+     *      Apply anything still queued now, e.g. before saving.
+     * */
+    void flush()
+    {
+        batch_timer->stop();
+        applyChanges();
+    }
+
+
+    /*
+     *      DataModel
+     * */
+    int childCount(const QVariantList &indexPath) override
+    {
+        return indexPath.isEmpty() ? items.size() : 0;
+    }
+
+
+    bool hasChildren(const QVariantList &indexPath) override
+    {
+        return indexPath.isEmpty();
+    }
+
+
+    QVariant data(const QVariantList &indexPath) override
+    {
+        if(indexPath.size() != 1)
+            return QVariant();
+
+        const int i = indexPath[0].toInt();
+
+        if(i < 0 || i >= items.size())
+            return QVariant();
+
+        if(!items[i].parsed)
+        {
+            requestPage(i / PAGE_SIZE);
+            return QVariantMap();
+        }
+
+        return items[i].map;
+    }
+
+
+Q_SIGNALS:
+    void loaded();
+    void batchApplied();
+};
+
+
+
+/*
+ * A view of some rows of a LibraryDataModel, in the given order.
+ * Used to show search results in the same grid as the library.
+ * */
+class LibraryFilterModel: public DataModel
+{
+    Q_OBJECT
+
+    LibraryDataModel *source;
+    QList<int> rows;
+
+
+    Q_SLOT void onSourceUpdated(QVariantList indexPath)
+    {
+        const int row = rows.indexOf( indexPath.value(0).toInt() );
+
+        if(row >= 0)
+            emit itemUpdated( QVariantList() << row );
+    }
+
+
+public:
+    LibraryFilterModel(LibraryDataModel *source, QObject *parent = nullptr): DataModel(parent), source(source)
+    {
+        bool connection;
+        connection = connect( source, SIGNAL(itemUpdated(QVariantList)), this, SLOT(onSourceUpdated(QVariantList)) );
+        Q_ASSERT( connection );
+        Q_UNUSED( connection );
+    }
+
+
+    //
+    //
+    void setRows(const QList<int> &rows)
+    {
+        this->rows = rows;
+        emit itemsChanged( DataModelChangeType::Init );
+    }
+
+
+    int sourceRow(int row) const { return rows.value(row, -1); }
+
+
+    /*
+     *      DataModel
+     * */
+    int childCount(const QVariantList &indexPath) override
+    {
+        return indexPath.isEmpty() ? rows.size() : 0;
+    }
+
+
+    bool hasChildren(const QVariantList &indexPath) override
+    {
+        return indexPath.isEmpty();
+    }
+
+
+    QVariant data(const QVariantList &indexPath) override
+    {
+        if(indexPath.size() != 1 || sourceRow(indexPath[0].toInt()) < 0)
+            return QVariant();
+
+        return source->data( QVariantList() << sourceRow(indexPath[0].toInt()) );
+    }
+};
@@ -0,0 +1,209 @@
+/*
+ * Profile.hpp
+ *
+ *  Created on: Oct 19, 2026
+ *      Author: swatson
+ */
+
+#pragma once
+
+#include <time.h>
+#include <stdint.h>
+
+#if defined(__QNX__)
+#include <sys/neutrino.h>
+#include <sys/syspage.h>
+#endif
+
+
+#include <QString>
+#include <QStringList>
+
+
+/*
+ * Where the emulation thread's time goes, by core subsystem.
+ *
+ * Built in with CONFIG+=markv_profile (MARKV_PROFILE), which also
+ * links the core with -Wl,--wrap for each of its phase functions so
+ * the calls system_frame_* makes into them land in the __wrap_
+ * functions of ProfileHooks.cpp first:
+ *
+ *     m68k_run       68k        main CPU
+ *     z80_run        Z80        sound CPU, also run from 68k bus accesses
+ *     render_line    VDP        line rendering
+ *     YM2612Update   YM2612     FM synthesis
+ *     psg_end_frame  PSG
+ *     s68k_run       Sub 68k    Sega CD
+ *     cdd_update     CDD        Sega CD drive
+ *
+ * Only calls between the core's object files are wrapped, which is
+ * all of the above. Time is exclusive: a Z80 run inside a 68k bus
+ * access is taken off the 68k. Whatever is left of the frame is
+ * counted as Other.
+ *
+ * The core runs on one thread at a time so the counters are plain
+ * statics. Cycles come from ClockCycles() on QNX and the monotonic
+ * clock in nanoseconds elsewhere.
+ * */
+class Profile
+{
+public:
+    enum Subsystem { M68K, Z80, VDP, YM2612, PSG, S68K, CDD, OTHER, SUBSYSTEMS };
+
+
+    struct Breakdown
+    {
+        qint64 frames;
+        uint64_t cycles[SUBSYSTEMS];
+    };
+
+
+    static const char *name(int subsystem)
+    {
+        static const char *const names[SUBSYSTEMS] = { "68k", "Z80", "VDP", "YM2612", "PSG", "Sub 68k", "CDD", "Other" };
+        return names[subsystem];
+    }
+
+
+    static uint64_t cycles()
+    {
+#if defined(__QNX__)
+        return ClockCycles();
+#else
+        timespec now;
+        clock_gettime(CLOCK_MONOTONIC, &now);
+
+        return (uint64_t)now.tv_sec * 1000000000ull + now.tv_nsec;
+#endif
+    }
+
+
+    static uint64_t cyclesPerSecond()
+    {
+#if defined(__QNX__)
+        return SYSPAGE_ENTRY(qtime)->cycles_per_sec;
+#else
+        return 1000000000ull;
+#endif
+    }
+
+
+    /* Times one emulated frame. */
+    class Frame
+    {
+    public:
+        Frame()
+        {
+            state().depth = 0;
+            state().stack[0] = OTHER;
+            state().mark = cycles();
+            state().active = true;
+        }
+
+        ~Frame()
+        {
+            charge();
+            state().active = false;
+            state().totals.frames++;
+        }
+    };
+
+
+    /* Times one call into a subsystem. */
+    class Scope
+    {
+        bool counted;
+
+    public:
+        explicit Scope(Subsystem subsystem): counted(state().active && state().depth + 1 < MAX_DEPTH)
+        {
+            if(counted)
+            {
+                charge();
+                state().stack[++state().depth] = subsystem;
+            }
+        }
+
+        ~Scope()
+        {
+            if(counted)
+            {
+                charge();
+                state().depth--;
+            }
+        }
+    };
+
+
+    /*
+     *      What was counted since the last call.
+     * */
+    static Breakdown take()
+    {
+        const Breakdown breakdown = state().totals;
+        state().totals = Breakdown();
+
+        return breakdown;
+    }
+
+
+    /*
+     *      e.g. "68k 5210us (61%), Z80 ... over 3600 frames", per frame.
+     * */
+    static QString report(const Breakdown &breakdown)
+    {
+        uint64_t total = 0;
+        for(int i = 0; i < SUBSYSTEMS; i++)
+            total += breakdown.cycles[i];
+
+        if(!breakdown.frames || !total)
+            return "no frames";
+
+        QStringList parts;
+        for(int i = 0; i < SUBSYSTEMS; i++)
+        {
+            const double us = breakdown.cycles[i] * 1000000.0 / cyclesPerSecond() / breakdown.frames;
+
+            parts << QString("%1 %2us (%3%)").arg(name(i)).arg(us, 0, 'f', 0).arg(breakdown.cycles[i] * 100.0 / total, 0, 'f', 1);
+        }
+
+        return parts.join(", ") + QString(" per frame over %1 frames").arg(breakdown.frames);
+    }
+
+
+private:
+    static constexpr auto MAX_DEPTH = 8;
+
+    struct State
+    {
+        bool active;
+        int depth;
+        int stack[MAX_DEPTH];
+        uint64_t mark;
+        Breakdown totals;
+    };
+
+
+    static State &state()
+    {
+        static State state = State();
+        return state;
+    }
+
+
+    /* Give the time since the last mark to whatever is running. */
+    static void charge()
+    {
+        const uint64_t now = cycles();
+
+        state().totals.cycles[ state().stack[state().depth] ] += now - state().mark;
+        state().mark = now;
+    }
+};
+
+
+#ifdef MARKV_PROFILE
+#define PROFILE_FRAME() Profile::Frame profile_frame
+#else
+#define PROFILE_FRAME() do {} while(0)
+#endif
@@ -0,0 +1,67 @@
+/*
+ * ProfileHooks.cpp
+ *
+ *  Created on: Oct 19, 2026
+ *      Author: swatson
+ */
+
+#include "Profile.hpp"
+
+
+/*
+ * The wrapped core functions (see Profile.hpp). Only compiled with
+ * CONFIG+=markv_profile, which links the core with the --wrap flags.
+ * */
+extern "C" {
+
+void __real_m68k_run(unsigned int cycles);
+void __real_z80_run(unsigned int cycles);
+void __real_render_line(int line);
+void __real_YM2612Update(int *buffer, int length);
+void __real_psg_end_frame(unsigned int clocks);
+void __real_s68k_run(unsigned int cycles);
+void __real_cdd_update(void);
+
+void __wrap_m68k_run(unsigned int cycles)
+{
+    Profile::Scope scope(Profile::M68K);
+    __real_m68k_run(cycles);
+}
+
+void __wrap_z80_run(unsigned int cycles)
+{
+    Profile::Scope scope(Profile::Z80);
+    __real_z80_run(cycles);
+}
+
+void __wrap_render_line(int line)
+{
+    Profile::Scope scope(Profile::VDP);
+    __real_render_line(line);
+}
+
+void __wrap_YM2612Update(int *buffer, int length)
+{
+    Profile::Scope scope(Profile::YM2612);
+    __real_YM2612Update(buffer, length);
+}
+
+void __wrap_psg_end_frame(unsigned int clocks)
+{
+    Profile::Scope scope(Profile::PSG);
+    __real_psg_end_frame(clocks);
+}
+
+void __wrap_s68k_run(unsigned int cycles)
+{
+    Profile::Scope scope(Profile::S68K);
+    __real_s68k_run(cycles);
+}
+
+void __wrap_cdd_update(void)
+{
+    Profile::Scope scope(Profile::CDD);
+    __real_cdd_update();
+}
+
+}
@@ -0,0 +1,528 @@
+/*
+ * RomPatcher.hpp
+ *
+ *  Created on: Oct 19, 2026
+ *      Author: swatson
+ */
+
+#pragma once
+
+#include "Trace.hpp"
+
+
+#include <zlib.h>
+
+#include <vector>
+#include <cstring>
+#include <cstdint>
+
+
+#include <QDir>
+#include <QFile>
+#include <QDebug>
+#include <QString>
+#include <QFileInfo>
+#include <QStringList>
+#include <QElapsedTimer>
+
+
+/*
+ * Soft patching: IPS and BPS patches applied when a game is loaded.
+ *
+ * A game's library entry lists its patches by file name in
+ * data/patches/<gameID>/, applied in order; two games' patches often
+ * share a name. prepare() hands back the image
+ * load_rom should read: the ROM itself without patches, otherwise
+ *
+ *     data/patched/<base CRC>_<patch hash>.bin
+ *
+ * built the first time and read straight back every time after, so
+ * only the patches are hashed on later launches. The ROM and patches
+ * are memory mapped and the last patch writes straight into a mapping
+ * of the cached image; earlier ones in a chain go through memory.
+ *
+ * BPS carries the CRCs of its source, target and of itself and all
+ * three are checked. IPS carries none, so the entry can give the CRC
+ * the patched image should have (patchedCRC), usually from the patch's
+ * readme. A cached image is written under a temporary name and only
+ * renamed into place once it has been verified, so one that exists
+ * is whole. Only the latest patch set of a game is kept.
+ *
+ * A state saved with one patch set may not make sense with another,
+ * so snapshots carry the set's hash (see key()) and the resume state
+ * of another set is not restored.
+ * */
+class RomPatcher
+{
+    /* A read-only view of a mapped file or of memory. */
+    struct Span
+    {
+        const uint8_t *data;
+        qint64 size;
+    };
+
+
+    static bool fail(QString *error, const QString &message)
+    {
+        if(error)
+            *error = message;
+
+        return false;
+    }
+
+
+    static quint32 crc(const uint8_t *data, qint64 size)
+    {
+        return crc32(crc32(0L, Z_NULL, 0), data, size);
+    }
+
+
+    static quint32 read32(const uint8_t *data)
+    {
+        return data[0] | (data[1] << 8) | (data[2] << 16) | ((quint32)data[3] << 24);
+    }
+
+
+    //
+    //
+    static bool readVarint(const Span &patch, qint64 &at, quint64 &value)
+    {
+        quint64 shift = 1;
+        value = 0;
+
+        while(at < patch.size)
+        {
+            const uint8_t x = patch.data[at++];
+            value += (x & 0x7f) * shift;
+
+            if(x & 0x80)
+                return true;
+
+            shift <<= 7;
+            value += shift;
+
+            if(shift > (1ull << 56))
+                return false;
+        }
+
+        return false;
+    }
+
+
+    /*
+     *      Size of what the patch makes of a source of this size.
+     * */
+    static qint64 targetSize(const Span &patch, qint64 source_size, QString *error)
+    {
+        if(patch.size >= 4 && !memcmp(patch.data, "BPS1", 4))
+        {
+            qint64 at = 4;
+            quint64 source, target;
+
+            if(!readVarint(patch, at, source) || !readVarint(patch, at, target))
+            {
+                fail(error, "truncated BPS header");
+                return -1;
+            }
+
+            if((qint64)source != source_size)
+            {
+                fail(error, "the BPS patch is for a ROM of another size");
+                return -1;
+            }
+
+            return target;
+        }
+
+        if(patch.size >= 8 && !memcmp(patch.data, "PATCH", 5))
+        {
+            qint64 at = 5;
+            qint64 size = source_size;
+
+            while(at + 3 <= patch.size)
+            {
+                const qint64 offset = (patch.data[at] << 16) | (patch.data[at + 1] << 8) | patch.data[at + 2];
+                at += 3;
+
+                if(offset == 0x454f46)   // "EOF", maybe followed by the size to truncate to
+                    return at + 3 <= patch.size ? (patch.data[at] << 16) | (patch.data[at + 1] << 8) | patch.data[at + 2] : size;
+
+                if(at + 2 > patch.size)
+                    break;
+
+                qint64 length = (patch.data[at] << 8) | patch.data[at + 1];
+                at += 2;
+
+                if(!length)
+                {
+                    if(at + 3 > patch.size)
+                        break;
+
+                    length = (patch.data[at] << 8) | patch.data[at + 1];
+                    at += 3;
+                }
+                else
+                {
+                    at += length;
+                }
+
+                size = qMax(size, offset + length);
+            }
+
+            fail(error, "truncated IPS patch");
+            return -1;
+        }
+
+        fail(error, "not an IPS or BPS patch");
+        return -1;
+    }
+
+
+    //
+    //
+    static bool applyIps(const Span &patch, const Span &source, uint8_t *target, qint64 target_size, QString *error)
+    {
+        memcpy(target, source.data, qMin(source.size, target_size));
+
+        if(target_size > source.size)
+            memset(target + source.size, 0, target_size - source.size);
+
+        for(qint64 at = 5; at + 3 <= patch.size; )
+        {
+            const qint64 offset = (patch.data[at] << 16) | (patch.data[at + 1] << 8) | patch.data[at + 2];
+            at += 3;
+
+            if(offset == 0x454f46)
+                return true;
+
+            qint64 length = (patch.data[at] << 8) | patch.data[at + 1];
+            at += 2;
+
+            // Records past a truncation are dropped along with the rest.
+            if(!length)
+            {
+                if(at + 3 > patch.size)
+                    break;
+
+                length = (patch.data[at] << 8) | patch.data[at + 1];
+
+                if(offset < target_size)
+                    memset(target + offset, patch.data[at + 2], qMin(length, target_size - offset));
+
+                at += 3;
+            }
+            else
+            {
+                if(at + length > patch.size)
+                    break;
+
+                if(offset < target_size)
+                    memcpy(target + offset, patch.data + at, qMin(length, target_size - offset));
+
+                at += length;
+            }
+        }
+
+        return fail(error, "truncated IPS patch");
+    }
+
+
+    //
+    //
+    static bool applyBps(const Span &patch, const Span &source, uint8_t *target, qint64 target_size, QString *error)
+    {
+        if(patch.size < 4 + 3 + 12)
+            return fail(error, "truncated BPS patch");
+
+        const uint8_t *footer = patch.data + patch.size - 12;
+
+        if(crc(patch.data, patch.size - 4) != read32(footer + 8))
+            return fail(error, "the BPS patch is damaged");
+
+        if(crc(source.data, source.size) != read32(footer))
+            return fail(error, "the BPS patch is for another ROM");
+
+        qint64 at = 4;
+        quint64 skip;
+        readVarint(patch, at, skip);
+        readVarint(patch, at, skip);
+
+        if(!readVarint(patch, at, skip) || (qint64)skip > patch.size - 12 - at)
+            return fail(error, "truncated BPS header");
+
+        at += skip;   // metadata
+
+        const qint64 end = patch.size - 12;
+        qint64 output = 0;
+        qint64 source_offset = 0;
+        qint64 target_offset = 0;
+
+        while(at < end)
+        {
+            quint64 data;
+
+            if(!readVarint(patch, at, data))
+                return fail(error, "truncated BPS patch");
+
+            const qint64 length = (data >> 2) + 1;
+
+            if(output + length > target_size)
+                return fail(error, "the BPS patch writes past its target");
+
+            switch(data & 3)
+            {
+            case 0:   // SourceRead
+                if(output + length > source.size)
+                    return fail(error, "the BPS patch reads past its source");
+
+                memcpy(target + output, source.data + output, length);
+                break;
+
+            case 1:   // TargetRead
+                if(at + length > end)
+                    return fail(error, "truncated BPS patch");
+
+                memcpy(target + output, patch.data + at, length);
+                at += length;
+                break;
+
+            case 2:   // SourceCopy
+            case 3:   // TargetCopy
+            {
+                quint64 relative;
+
+                if(!readVarint(patch, at, relative))
+                    return fail(error, "truncated BPS patch");
+
+                qint64 &offset = (data & 3) == 2 ? source_offset : target_offset;
+                offset += (relative & 1 ? -1 : 1) * (qint64)(relative >> 1);
+
+                if((data & 3) == 2)
+                {
+                    if(offset < 0 || offset + length > source.size)
+                        return fail(error, "the BPS patch reads past its source");
+
+                    memcpy(target + output, source.data + offset, length);
+                }
+                else
+                {
+                    if(offset < 0 || offset >= output)
+                        return fail(error, "the BPS patch reads past its target");
+
+                    // May overlap what it writes, byte by byte on purpose.
+                    for(qint64 i = 0; i < length; i++)
+                        target[output + i] = target[offset + i];
+                }
+
+                offset += length;
+                break;
+            }
+            }
+
+            output += length;
+        }
+
+        if(crc(target, target_size) != read32(footer + 4))
+            return fail(error, "the patched ROM doesn't match the BPS patch");
+
+        return true;
+    }
+
+
+    static bool apply(const Span &patch, const Span &source, uint8_t *target, qint64 target_size, QString *error)
+    {
+        TRACE_SPAN("RomPatcher::apply");
+
+        return !memcmp(patch.data, "BPS1", 4) ? applyBps(patch, source, target, target_size, error)
+                                              : applyIps(patch, source, target, target_size, error);
+    }
+
+
+    /*
+     *      Build and verify the patched image at path.
+     * */
+    static bool build(const QString &rom, const QString &gameID, const QStringList &patches, const QString &expected_crc, const QString &path, QString *error)
+    {
+        QFile base(rom);
+        if(!base.open(QIODevice::ReadOnly))
+            return fail(error, "can't open " + rom);
+
+        Span source = { base.map(0, base.size()), base.size() };
+        if(!source.data)
+            return fail(error, "can't map " + rom);
+
+        const QString temporary = path + ".part";
+        QFile out(temporary);
+        std::vector<uint8_t> chain[2];
+
+        for(int i = 0; i < patches.size(); i++)
+        {
+            QFile file(patchFile(gameID, patches[i]));
+            const bool last = i == patches.size() - 1;
+
+            if(!file.open(QIODevice::ReadOnly) || !file.size())
+                return fail(error, "can't open " + patches[i]);
+
+            const Span patch = { file.map(0, file.size()), file.size() };
+            if(!patch.data)
+                return fail(error, "can't map " + patches[i]);
+
+            const qint64 size = targetSize(patch, source.size, error);
+            if(size <= 0)
+                return false;
+
+            uint8_t *target;
+
+            if(last)
+            {
+                if(!out.open(QIODevice::ReadWrite | QIODevice::Truncate) || !out.resize(size) || !(target = out.map(0, size)))
+                    return fail(error, "can't write " + temporary);
+            }
+            else
+            {
+                chain[i % 2].resize(size);
+                target = chain[i % 2].data();
+            }
+
+            if(!apply(patch, source, target, size, error))
+            {
+                out.remove();
+                return false;
+            }
+
+            source.data = target;
+            source.size = size;
+        }
+
+        const QString &result = QString::number(crc(source.data, source.size), 16).toUpper();
+
+        if(!expected_crc.isEmpty() && result.compare(expected_crc, Qt::CaseInsensitive))
+        {
+            out.remove();
+            return fail(error, "the patched ROM's CRC is " + result + ", expected " + expected_crc.toUpper());
+        }
+
+        out.unmap( (uchar *)source.data );
+        out.close();
+
+        if(!QFile::rename(temporary, path))
+            return fail(error, "can't write " + path);
+
+        return true;
+    }
+
+
+public:
+    static QString patchDir(const QString &gameID)
+    {
+        return "data/patches/" + gameID + "/";
+    }
+
+
+    static QString patchFile(const QString &gameID, const QString &name)
+    {
+        return patchDir(gameID) + name;
+    }
+
+
+    /*
+     *      CRC over the patches in order, the second half of the cache key.
+     * */
+    static QString hash(const QString &gameID, const QStringList &patches)
+    {
+        uLong value = crc32(0L, Z_NULL, 0);
+
+        for(const auto &name : patches)
+        {
+            QFile file(patchFile(gameID, name));
+
+            if(!file.open(QIODevice::ReadOnly))
+                return QString();
+
+            const uchar *data = file.size() ? file.map(0, file.size()) : nullptr;
+            if(data)
+                value = crc32(value, data, file.size());
+
+            value = crc32(value, (const Bytef *)name.toUtf8().constData(), name.toUtf8().size());
+        }
+
+        return QString::number( (qulonglong)value, 16 ).toUpper();
+    }
+
+
+    /*
+     *      The image to load for a game. Without patches, or if they
+     *      can't be applied, that is the ROM itself; error says why.
+     * */
+    static QString prepare(const QString &rom, const QString &crc, const QStringList &patches, const QString &expected_crc = QString(), QString *error = nullptr)
+    {
+        if(patches.isEmpty())
+            return rom;
+
+        const QString &key = hash(crc, patches);
+        if(key.isEmpty())
+        {
+            fail(error, "missing patch");
+            return rom;
+        }
+
+        QDir().mkpath("data/patched");
+        const QString path = "data/patched/" + crc + "_" + key + ".bin";
+
+        if(QFileInfo(path).exists())
+            return path;
+
+        QElapsedTimer timer;
+        timer.start();
+
+        if(!build(rom, crc, patches, expected_crc, path, error))
+            return rom;
+
+        // Only the game's latest patch set is kept.
+        for(const auto &stale : QDir("data/patched").entryList(QStringList(crc + "_*.bin")))
+            if("data/patched/" + stale != path)
+                QFile::remove("data/patched/" + stale);
+
+        qDebug() << "RomPatcher:" << patches.size() << "patches applied to" << rom << "in" << timer.elapsed() << "ms";
+        return path;
+    }
+
+
+    /*
+     *      What a snapshot records of the image it was taken with:
+     *      the patch set's hash, empty for the ROM itself.
+     * */
+    static QString key(const QString &rom, const QString &image)
+    {
+        return image == rom ? QString() : QFileInfo(image).completeBaseName().section('_', 1);
+    }
+
+
+    /*
+     *      Drop patches the game no longer lists.
+     * */
+    static void prune(const QString &gameID, const QStringList &patches)
+    {
+        QDir dir(patchDir(gameID));
+
+        for(const auto &stale : dir.entryList(QDir::Files))
+            if(!patches.contains(stale))
+                dir.remove(stale);
+
+        if(patches.isEmpty())
+            QDir().rmdir(patchDir(gameID));
+    }
+
+
+    /*
+     *      Drop a game's patches and cached images, e.g. when it is
+     *      deleted or its patches are cleared.
+     * */
+    static void forget(const QString &crc)
+    {
+        for(const auto &stale : QDir("data/patched").entryList(QStringList() << crc + "_*.bin" << crc + "_*.bin.part"))
+            QFile::remove("data/patched/" + stale);
+
+        prune(crc, QStringList());
+    }
+};
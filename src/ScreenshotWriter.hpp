@@ -0,0 +1,182 @@
+/*
+ * ScreenshotWriter.hpp
+ *
+ *  Created on: Oct 19, 2026
+ *      Author: swatson
+ */
+
+#pragma once
+
+#include <cstring>
+#include <cstdint>
+
+
+#include <QImage>
+#include <QMutex>
+#include <QQueue>
+#include <QThread>
+#include <QObject>
+#include <QWaitCondition>
+
+
+/*
+ * Writes screenshots without stalling the emulation thread.
+ *
+ * capture() is called at a frame boundary and only copies the
+ * frame into one of a few pooled buffers. Conversion from RGB565
+ * and PNG encoding happen on this low priority thread. If every
+ * buffer is in flight the capture is dropped instead of waiting.
+ * */
+class ScreenshotWriter: public QThread
+{
+    Q_OBJECT
+
+    static constexpr auto POOL_SIZE = 3;
+
+    struct Frame
+    {
+        QByteArray pixels;
+        int width;
+        int height;
+        QString file;
+    };
+
+    QMutex mutex;
+    QWaitCondition ready;
+    QList<QByteArray> pool;
+    QQueue<Frame> queue;
+    bool stopping = false;
+    int dropped = 0;
+
+
+    static QImage toRGB888(const Frame &frame)
+    {
+        QImage img(frame.width, frame.height, QImage::Format_RGB888);
+        const uint16_t *src = (const uint16_t *)frame.pixels.constData();
+
+        for(int y = 0; y < frame.height; y++)
+        {
+            uchar *dst = img.scanLine(y);
+
+            for(int x = 0; x < frame.width; x++, src++)
+            {
+                const uint8_t r = (*src >> 11) & 0x1f;
+                const uint8_t g = (*src >> 5)  & 0x3f;
+                const uint8_t b = (*src)       & 0x1f;
+
+                *dst++ = (r << 3) | (r >> 2);
+                *dst++ = (g << 2) | (g >> 4);
+                *dst++ = (b << 3) | (b >> 2);
+            }
+        }
+
+        return img;
+    }
+
+
+    void run() override
+    {
+        forever
+        {
+            Frame frame;
+
+            {
+                QMutexLocker lk(&mutex);
+
+                while(queue.isEmpty() && !stopping)
+                    ready.wait(&mutex);
+
+                if(queue.isEmpty())
+                    return;
+
+                frame = queue.dequeue();
+            }
+
+            const bool saved = toRGB888(frame).save(frame.file, "png");
+
+            {
+                QMutexLocker lk(&mutex);
+                pool.append(frame.pixels);
+                frame.pixels = QByteArray();
+            }
+
+            if(saved)
+                emit screenshotSaved(frame.file);
+        }
+    }
+
+
+public:
+    ScreenshotWriter(int width, int height, QObject *parent = nullptr): QThread(parent)
+    {
+        for(int i = 0; i < POOL_SIZE; i++)
+            pool.append( QByteArray(width * height * sizeof(uint16_t), 0) );
+
+        start(QThread::LowestPriority);
+    }
+
+
+    ~ScreenshotWriter()
+    {
+        {
+            QMutexLocker lk(&mutex);
+            stopping = true;
+            ready.wakeOne();
+        }
+
+        wait();
+    }
+
+
+    int droppedCount() { QMutexLocker lk(&mutex); return dropped; }
+
+
+    /*
+     *      Copy the visible area of an RGB565 frame and queue it. Safe to
+     *      call from the emulation thread; it never blocks on the encoder.
+     * */
+    bool capture(const uint8_t *data, int pitch, int width, int height, const QString &file)
+    {
+        Frame frame;
+
+        {
+            QMutexLocker lk(&mutex);
+
+            if(pool.isEmpty() || pool.first().size() < width * height * (int)sizeof(uint16_t))
+            {
+                dropped++;
+                return false;
+            }
+
+            frame.pixels = pool.takeFirst();
+        }
+
+        /* Pooled buffers are never shared so data() won't detach. */
+        uint8_t *dst = (uint8_t *)frame.pixels.data();
+        const int row = width * sizeof(uint16_t);
+
+        if(pitch == row)
+        {
+            memcpy(dst, data, row * height);
+        }
+        else
+        {
+            for(int y = 0; y < height; y++)
+                memcpy(dst + y * row, data + y * pitch, row);
+        }
+
+        frame.width  = width;
+        frame.height = height;
+        frame.file   = file;
+
+        QMutexLocker lk(&mutex);
+        queue.enqueue(frame);
+        ready.wakeOne();
+
+        return true;
+    }
+
+
+Q_SIGNALS:
+    void screenshotSaved(const QString &file);
+};
@@ -0,0 +1,462 @@
+/*
+ * SessionRecorder.hpp
+ *
+ *  Created on: Oct 19, 2026
+ *      Author: swatson
+ */
+
+#pragma once
+
+#include "Trace.hpp"
+
+
+#include <cstring>
+#include <cstdint>
+
+
+#include <QFile>
+#include <QMutex>
+#include <QQueue>
+#include <QThread>
+#include <QString>
+#include <QByteArray>
+#include <QDataStream>
+#include <QWaitCondition>
+
+
+/*
+ * Records a game session losslessly without stalling the emulation thread.
+ *
+ * capture() is called at each frame boundary and only copies the
+ * frame's visible area into one of POOL_SIZE pooled buffers and its
+ * sound onto the pending audio. Encoding and writing happen on this
+ * thread. If every buffer is in flight the frame is dropped and
+ * counted instead of waiting; its sound is still kept, so the
+ * recording stays in sync and the frame before it is just shown
+ * for longer.
+ *
+ * A recording is two files, <name>.mkvr and <name>.wav. The WAV is
+ * plain 16 bit stereo PCM. The .mkvr is little endian:
+ *
+ *     "MKVR", quint32 version, double frame rate, quint32 sample rate
+ *     then for each frame recorded:
+ *         quint32 frame    counts every frame captured, so a gap means
+ *                          dropped frames
+ *         quint16 width, height
+ *         quint8  key      1 if the pixels are the frame itself, 0 if
+ *                          they are XORed with the previous frame
+ *         quint32 size, then qCompress()ed RGB565 pixels: a 4 byte big
+ *                          endian length followed by a zlib stream
+ *
+ * A key frame is written every KEY_INTERVAL frames and whenever the
+ * size changes. The XOR with the previous frame leaves mostly zeros
+ * for zlib, which keeps the stream around a tenth of the raw frames
+ * at the fastest level. HeadlessRunner --convert-recording turns it
+ * into raw frames ffmpeg can read (see Reader).
+ * */
+class SessionRecorder: public QThread
+{
+public:
+    struct Stats
+    {
+        qint64 frames;         // captured
+        qint64 dropped;        // frames the encoder had no room for
+        qint64 audio_dropped;  // bytes of sound it had no room for
+        qint64 bytes;          // written
+    };
+
+
+    static constexpr auto VERSION = 1;
+
+
+    /*
+     *      Decodes a .mkvr, with frames dropped while recording
+     *      repeated so there is one per frame captured.
+     * */
+    class Reader
+    {
+        QFile file;
+        QDataStream in;
+        QByteArray frame;
+        int width = 0;
+        int height = 0;
+        quint32 index = 0;
+
+        /* The record after the frame being shown. */
+        bool pending = false;
+        quint32 pending_index = 0;
+        quint16 pending_width = 0;
+        quint16 pending_height = 0;
+        quint8 pending_key = 0;
+        QByteArray pending_data;
+
+
+        bool fetch()
+        {
+            quint32 size;
+
+            if(in.atEnd())
+                return false;
+
+            in >> pending_index >> pending_width >> pending_height >> pending_key >> size;
+
+            pending_data.resize(size);
+            return in.readRawData(pending_data.data(), size) == (int)size;
+        }
+
+
+        void apply()
+        {
+            const QByteArray &delta = qUncompress(pending_data);
+
+            if(pending_key || frame.size() != delta.size())
+            {
+                frame = delta;
+            }
+            else
+            {
+                char *out = frame.data();
+                for(int i = 0; i < delta.size(); i++)
+                    out[i] ^= delta[i];
+            }
+
+            width = pending_width;
+            height = pending_height;
+        }
+
+
+    public:
+        double frame_rate = 0;
+        quint32 sample_rate = 0;
+
+
+        Reader(const QString &path): file(path)
+        {
+            if(!file.open(QIODevice::ReadOnly))
+                return;
+
+            in.setDevice(&file);
+            in.setByteOrder(QDataStream::LittleEndian);
+
+            char magic[4];
+            quint32 version = 0;
+
+            if(in.readRawData(magic, 4) != 4 || memcmp(magic, "MKVR", 4))
+                return;
+
+            in >> version >> frame_rate >> sample_rate;
+
+            if(version != VERSION)
+                frame_rate = 0;
+            else
+                pending = fetch();
+        }
+
+
+        bool isValid() const { return frame_rate > 0; }
+
+
+        /* The next frame's RGB565 pixels, false at the end of the stream. */
+        bool read(QByteArray *pixels, int *w, int *h)
+        {
+            // A frame dropped while recording repeats the one before it.
+            if(pending && (pending_index <= index || frame.isEmpty()))
+            {
+                apply();
+                pending = fetch();
+            }
+            else if(!pending)
+            {
+                return false;
+            }
+
+            *pixels = frame;
+            *w = width;
+            *h = height;
+
+            index++;
+            return !frame.isEmpty();
+        }
+    };
+
+
+private:
+    static constexpr auto POOL_SIZE = 8;
+    static constexpr auto KEY_INTERVAL = 300;
+    static constexpr auto AUDIO_LIMIT = 2 * 44100 * 4;   // two seconds of 16 bit stereo
+
+    struct Frame
+    {
+        QByteArray pixels;
+        int width;
+        int height;
+        quint32 index;
+    };
+
+    QMutex mutex;
+    QWaitCondition ready;
+    QList<QByteArray> pool;
+    QQueue<Frame> queue;
+    QByteArray audio;
+    bool recording = false;
+    bool stopping = false;
+    quint32 next_index = 0;
+    Stats counts = Stats();
+
+    /* Only the encoder touches these while recording. */
+    QFile video_file;
+    QFile audio_file;
+    QByteArray previous;
+    int previous_width = 0;
+    int previous_height = 0;
+    quint32 audio_size = 0;
+    int sample_rate = 0;
+
+
+    void writeWavHeader()
+    {
+        const quint32 riff_size = 36 + audio_size;
+        const quint32 fmt_size = 16;
+        const quint16 pcm = 1;
+        const quint16 channels = 2;
+        const quint32 rate = sample_rate;
+        const quint32 byte_rate = sample_rate * 4;
+        const quint16 align = 4;
+        const quint16 bits = 16;
+
+        audio_file.seek(0);
+        audio_file.write("RIFF", 4); audio_file.write((const char *)&riff_size, 4);
+        audio_file.write("WAVEfmt ", 8); audio_file.write((const char *)&fmt_size, 4);
+        audio_file.write((const char *)&pcm, 2); audio_file.write((const char *)&channels, 2);
+        audio_file.write((const char *)&rate, 4); audio_file.write((const char *)&byte_rate, 4);
+        audio_file.write((const char *)&align, 2); audio_file.write((const char *)&bits, 2);
+        audio_file.write("data", 4); audio_file.write((const char *)&audio_size, 4);
+        audio_file.seek(audio_file.size());
+    }
+
+
+    /* XOR against the last frame written, unless it is a key frame. */
+    qint64 encode(Frame &frame)
+    {
+        TRACE_SPAN("SessionRecorder::encode");
+
+        const int size = frame.width * frame.height * sizeof(uint16_t);
+        const bool key = frame.index % KEY_INTERVAL == 0 || frame.width != previous_width || frame.height != previous_height;
+
+        QByteArray delta( (const char *)frame.pixels.constData(), size );
+
+        if(!key)
+        {
+            const uint16_t *last = (const uint16_t *)previous.constData();
+            uint16_t *out = (uint16_t *)delta.data();
+
+            for(int i = 0; i < frame.width * frame.height; i++)
+                out[i] ^= last[i];
+        }
+
+        previous.resize(size);
+        memcpy(previous.data(), frame.pixels.constData(), size);
+        previous_width = frame.width;
+        previous_height = frame.height;
+
+        const QByteArray &data = qCompress(delta, 1);
+
+        QDataStream out(&video_file);
+        out.setByteOrder(QDataStream::LittleEndian);
+        out << frame.index << (quint16)frame.width << (quint16)frame.height << (quint8)key << (quint32)data.size();
+        out.writeRawData(data.constData(), data.size());
+
+        return 15 + data.size();
+    }
+
+
+    void run() override
+    {
+        forever
+        {
+            Frame frame;
+            QByteArray sound;
+
+            {
+                QMutexLocker lk(&mutex);
+
+                while(queue.isEmpty() && audio.isEmpty() && !stopping)
+                    ready.wait(&mutex);
+
+                if(queue.isEmpty() && audio.isEmpty())
+                    return;
+
+                if(!queue.isEmpty())
+                    frame = queue.dequeue();
+
+                sound.swap(audio);
+            }
+
+            qint64 written = 0;
+
+            if(!frame.pixels.isEmpty())
+                written += encode(frame);
+
+            if(!sound.isEmpty())
+            {
+                audio_size += audio_file.write(sound);
+                written += sound.size();
+            }
+
+            QMutexLocker lk(&mutex);
+            counts.bytes += written;
+
+            // Moved rather than copied: frame only lets go of it after
+            // the unlock, and a buffer still shared then would detach
+            // when capture() writes to it.
+            if(!frame.pixels.isEmpty())
+            {
+                pool.append( QByteArray() );
+                pool.last().swap(frame.pixels);
+            }
+        }
+    }
+
+
+public:
+    SessionRecorder(QObject *parent = nullptr): QThread(parent)
+    {
+        setObjectName("recorder");
+    }
+
+
+    ~SessionRecorder()
+    {
+        close();
+    }
+
+
+    bool isRecording() { QMutexLocker lk(&mutex); return recording; }
+
+
+    /*
+     *      Start writing <name>.mkvr and <name>.wav.
+     * */
+    bool open(const QString &name, int width, int height, double frame_rate, int sample_rate)
+    {
+        if(isRunning())
+            return false;
+
+        video_file.setFileName(name + ".mkvr");
+        audio_file.setFileName(name + ".wav");
+
+        if(!video_file.open(QIODevice::WriteOnly | QIODevice::Truncate) || !audio_file.open(QIODevice::WriteOnly | QIODevice::Truncate))
+        {
+            video_file.close();
+            audio_file.close();
+            return false;
+        }
+
+        QDataStream out(&video_file);
+        out.setByteOrder(QDataStream::LittleEndian);
+        out.writeRawData("MKVR", 4);
+        out << (quint32)VERSION << frame_rate << (quint32)sample_rate;
+
+        this->sample_rate = sample_rate;
+        audio_size = 0;
+        writeWavHeader();
+
+        previous.clear();
+        previous_width = previous_height = 0;
+
+        QMutexLocker lk(&mutex);
+
+        pool.clear();
+        for(int i = 0; i < POOL_SIZE; i++)
+            pool.append( QByteArray(width * height * sizeof(uint16_t), 0) );
+
+        queue.clear();
+        audio.clear();
+        counts = Stats();
+        next_index = 0;
+        stopping = false;
+        recording = true;
+
+        QThread::start(QThread::LowPriority);
+        return true;
+    }
+
+
+    /*
+     *      Write out what is queued and close the files.
+     * */
+    Stats close()
+    {
+        {
+            QMutexLocker lk(&mutex);
+
+            if(!recording)
+                return counts;
+
+            recording = false;
+            stopping = true;
+            ready.wakeOne();
+        }
+
+        wait();
+
+        writeWavHeader();
+        video_file.close();
+        audio_file.close();
+
+        QMutexLocker lk(&mutex);
+        pool.clear();
+        previous.clear();
+
+        return counts;
+    }
+
+
+    /*
+     *      Copy the visible area of an RGB565 frame and its sound and
+     *      queue them. Safe to call from the emulation thread; it never
+     *      blocks on the encoder.
+     * */
+    void capture(const uint8_t *data, int pitch, int width, int height, const int16_t *samples, int frames)
+    {
+        Frame frame;
+
+        {
+            QMutexLocker lk(&mutex);
+
+            if(!recording)
+                return;
+
+            frame.index = next_index++;
+            counts.frames++;
+
+            if(audio.size() + frames * 4 <= AUDIO_LIMIT)
+                audio.append( (const char *)samples, frames * 4 );
+            else
+                counts.audio_dropped += frames * 4;
+
+            if(pool.isEmpty() || pool.first().size() < width * height * (int)sizeof(uint16_t))
+            {
+                counts.dropped++;
+                ready.wakeOne();
+                return;
+            }
+
+            frame.pixels = pool.takeFirst();
+        }
+
+        /* Pooled buffers are never shared so data() won't detach. */
+        uint8_t *dst = (uint8_t *)frame.pixels.data();
+        const int row = width * sizeof(uint16_t);
+
+        for(int y = 0; y < height; y++)
+            memcpy(dst + y * row, data + y * pitch, row);
+
+        frame.width  = width;
+        frame.height = height;
+
+        QMutexLocker lk(&mutex);
+        queue.enqueue(frame);
+        ready.wakeOne();
+    }
+};
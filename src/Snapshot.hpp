@@ -0,0 +1,310 @@
+/*
+ * Snapshot.hpp
+ *
+ *  Created on: Oct 19, 2026
+ *      Author: swatson
+ */
+
+#pragma once
+
+extern "C" {
+#ifndef Q_MOC_RUN
+#include <shared.h>
+#endif
+}
+
+#include "ChunkStore.hpp"
+#include "CoverPreview.hpp"
+#include "Trace.hpp"
+
+
+#include <vector>
+#include <cstring>
+#include <cstdint>
+
+
+#include <QFile>
+#include <QImage>
+#include <QBuffer>
+#include <QString>
+#include <QDebug>
+#include <QVariant>
+#include <QByteArray>
+#include <QDataStream>
+#include <QElapsedTimer>
+
+
+/*
+ * Emulator state as a file.
+ *
+ * A snapshot starts with a header that can be read on its own:
+ *
+ *     "MKV2"              magic and version
+ *     QVariantMap meta    gameID, title, timestamp and playTime (ms)
+ *     QByteArray          PNG thumbnail at half the frame size
+ *     QList<QByteArray>   the state's chunks in data/<gameID>.chunks
+ *
+ * Version 1 files held the zlib compressed state in place of the
+ * chunk list and can still be read.
+ *
+ * capture(), grab() and restore() touch the core and must only be
+ * called while the emulation thread is stopped or paused between
+ * frames. write() and the readers only touch the file system and
+ * are safe to run on any thread.
+ * */
+class Snapshot
+{
+    static constexpr auto MAGIC_SIZE = 4;
+
+    /* A function rather than a static array so it needs no definition outside the class. */
+    static const char *magic() { return "MKV2"; }
+
+
+    /* Returns the version, or 0 if it isn't a snapshot. */
+    static int readMagic(QFile &in)
+    {
+        char bytes[MAGIC_SIZE];
+
+        if(in.read(bytes, MAGIC_SIZE) != MAGIC_SIZE || memcmp(bytes, magic(), MAGIC_SIZE - 1))
+            return 0;
+
+        return bytes[MAGIC_SIZE - 1] - '0';
+    }
+
+
+public:
+    struct Frame
+    {
+        QByteArray pixels;
+        int width;
+        int height;
+    };
+
+
+    //
+    //
+    static QByteArray capture()
+    {
+        TRACE_SPAN("Snapshot::capture");
+
+        QByteArray state(STATE_SIZE, 0);
+        state.resize( state_save((unsigned char *)state.data()) );
+
+        return state;
+    }
+
+
+    /*
+     *      A packed copy of the visible RGB565 frame.
+     * */
+    static Frame grab()
+    {
+        Frame frame;
+        frame.width  = bitmap.viewport.w;
+        frame.height = bitmap.viewport.h;
+        frame.pixels.resize( frame.width * frame.height * sizeof(uint16_t) );
+
+        for(int y = 0; y < frame.height; y++)
+            memcpy( frame.pixels.data() + y * frame.width * sizeof(uint16_t),
+                    bitmap.data + (bitmap.viewport.y + y) * bitmap.pitch + bitmap.viewport.x * sizeof(uint16_t),
+                    frame.width * sizeof(uint16_t) );
+
+        return frame;
+    }
+
+
+    //
+    //
+    static bool restore(const QByteArray &state)
+    {
+        TRACE_SPAN("Snapshot::restore");
+
+        if(state.isEmpty())
+            return false;
+
+        // state_load reads up to STATE_SIZE bytes whatever the blob holds.
+        QByteArray padded(state);
+        padded.resize( qMax(state.size(), STATE_SIZE) );
+
+        return state_load((unsigned char *)padded.data()) > 0;
+    }
+
+
+    /*
+     *      Half size PNG of a frame.
+     * */
+    static QByteArray thumbnail(const Frame &frame)
+    {
+        const int width  = frame.width & ~15;
+        const int height = frame.height & ~1;
+
+        if(width <= 0 || height <= 0)
+            return QByteArray();
+
+        QImage image(width / 2, height / 2, QImage::Format_RGB16);
+        std::vector<uint16_t> half( (width / 2) * (height / 2) );
+
+        CoverPreview::downscale( (const uint8_t *)frame.pixels.constData(), frame.width * sizeof(uint16_t), width, height, half.data() );
+
+        for(int y = 0; y < height / 2; y++)
+            memcpy( image.scanLine(y), half.data() + y * (width / 2), (width / 2) * sizeof(uint16_t) );
+
+        QByteArray png;
+        QBuffer buffer(&png);
+        buffer.open(QIODevice::WriteOnly);
+        image.save(&buffer, "PNG");
+
+        return png;
+    }
+
+
+    /*
+     *      Where a game's chunks are kept.
+     * */
+    static QString chunks(const QString &gameID)
+    {
+        return "data/" + gameID + ".chunks";
+    }
+
+
+    /*
+     *      Store the chunks, make the thumbnail and write next to the
+     *      target first so a crash never leaves a half written snapshot.
+     * */
+    static bool write(const QString &file, const QByteArray &state, const Frame &frame, const QVariantMap &meta)
+    {
+        TRACE_SPAN("Snapshot::write");
+
+        QElapsedTimer timer;
+        timer.start();
+
+        const QString &dir = chunks(meta.value("gameID").toString());
+
+        // Until the manifest is on disk nothing else says its chunks are in use.
+        ChunkStore::pin(dir);
+        const bool written = write(file, dir, state, frame, meta, timer);
+        ChunkStore::unpin(dir);
+
+        return written;
+    }
+
+
+    /*
+     *      Everything write() does once the store is pinned.
+     * */
+    static bool write(const QString &file, const QString &dir, const QByteArray &state, const Frame &frame, const QVariantMap &meta, QElapsedTimer &timer)
+    {
+        ChunkStore::Stats stats;
+        const auto &manifest = ChunkStore::store( dir, state, &stats );
+
+        if(manifest.isEmpty())
+            return false;
+
+#ifdef QT_DEBUG
+        const qint64 chunked = timer.nsecsElapsed();
+        timer.restart();
+        const int zlib_size = qCompress(state, 6).size();
+
+        qDebug() << "Snapshot:" << file << "wrote" << stats.written << "of" << stats.chunks << "chunks (" << stats.deltas << "deltas )"
+                 << stats.bytes << "bytes in" << chunked / 1000 << "us, zlib would be" << zlib_size << "bytes in" << timer.nsecsElapsed() / 1000 << "us";
+#endif
+
+        QFile out(file + ".tmp");
+
+        if(!out.open(QIODevice::WriteOnly | QIODevice::Truncate))
+            return false;
+
+        out.write(magic(), MAGIC_SIZE);
+
+        QDataStream stream(&out);
+        stream << meta << thumbnail(frame) << manifest;
+
+        if(stream.status() != QDataStream::Ok || !out.flush())
+        {
+            out.remove();
+            return false;
+        }
+
+        out.close();
+        QFile::remove(file);
+
+        return out.rename(file);
+    }
+
+
+    /*
+     *      Only the header; the state is never read.
+     * */
+    static bool readHeader(const QString &file, QVariantMap *meta, QByteArray *thumbnail)
+    {
+        QFile in(file);
+
+        if(!in.open(QIODevice::ReadOnly) || !readMagic(in))
+            return false;
+
+        QDataStream stream(&in);
+        stream >> *meta >> *thumbnail;
+
+        return stream.status() == QDataStream::Ok;
+    }
+
+
+    //
+    //
+    static QByteArray read(const QString &file, QVariantMap *meta = nullptr)
+    {
+        TRACE_SPAN("Snapshot::read");
+
+        QFile in(file);
+        const int version = in.open(QIODevice::ReadOnly) ? readMagic(in) : 0;
+
+        if(version < 1 || version > 2)
+            return QByteArray();
+
+        QVariantMap header;
+        QByteArray thumbnail;
+
+        QDataStream stream(&in);
+        stream >> header >> thumbnail;
+
+        if(meta)
+            *meta = header;
+
+        if(version == 1)
+        {
+            QByteArray state;
+            stream >> state;
+
+            return stream.status() == QDataStream::Ok ? qUncompress(state) : QByteArray();
+        }
+
+        QList<QByteArray> manifest;
+        stream >> manifest;
+
+        if(stream.status() != QDataStream::Ok)
+            return QByteArray();
+
+        return ChunkStore::load( chunks(header.value("gameID").toString()), manifest );
+    }
+
+
+    /*
+     *      The chunks a snapshot needs, for collecting the rest.
+     * */
+    static QList<QByteArray> manifest(const QString &file)
+    {
+        QFile in(file);
+        QList<QByteArray> manifest;
+
+        if(!in.open(QIODevice::ReadOnly) || readMagic(in) < 2)
+            return manifest;
+
+        QVariantMap meta;
+        QByteArray thumbnail;
+
+        QDataStream stream(&in);
+        stream >> meta >> thumbnail >> manifest;
+
+        return manifest;
+    }
+};
@@ -0,0 +1,169 @@
+/*
+ * StateListModel.hpp
+ *
+ *  Created on: Oct 19, 2026
+ *      Author: swatson
+ */
+
+#pragma once
+
+#include "Snapshot.hpp"
+
+
+#include <QSet>
+#include <QList>
+#include <QObject>
+#include <QVariant>
+#include <QStringList>
+#include <QFutureWatcher>
+#include <QtConcurrentRun>
+
+// Data Models
+#include <bb/cascades/DataModel>
+
+using namespace bb::cascades;
+
+
+/*
+ * The saved states of one game. Items start out as just a file
+ * name and their snapshot headers (meta data and thumbnail) are
+ * read a page at a time on a background thread when the ListView
+ * first asks for them.
+ *
+ * Each item is a map of
+ *
+ *     file: the state's file name in the data folder.
+ *     resume: true for the state the game was closed in.
+ *     meta: the snapshot's meta data, once loaded.
+ *     thumbnail: the snapshot's PNG thumbnail, once loaded.
+ * */
+class StateListModel: public DataModel
+{
+    Q_OBJECT
+
+    static constexpr auto PAGE_SIZE = 8;
+
+    QList<QVariantMap> items;
+    QSet<int> pending_pages;
+
+
+    static QVariantList readHeaders(const QStringList &files)
+    {
+        QVariantList headers;
+
+        for(const auto &file : files)
+        {
+            QVariantMap header;
+            QVariantMap meta;
+            QByteArray thumbnail;
+
+            if(Snapshot::readHeader("data/" + file, &meta, &thumbnail))
+            {
+                header["meta"] = meta;
+                header["thumbnail"] = thumbnail;
+            }
+
+            headers << header;
+        }
+
+        return headers;
+    }
+
+
+    Q_SLOT void onPageRead()
+    {
+        auto *watcher = static_cast<QFutureWatcher<QVariantList>*>( sender() );
+        const int page = watcher->property("page").toInt();
+        const auto &headers = watcher->result();
+
+        watcher->deleteLater();
+
+        for(int i = 0; i < headers.size() && page * PAGE_SIZE + i < items.size(); i++)
+        {
+            QVariantMap &item = items[page * PAGE_SIZE + i];
+            const QVariantMap &header = headers[i].toMap();
+
+            item["loaded"] = true;
+            item["meta"] = header.value("meta");
+            item["thumbnail"] = header.value("thumbnail");
+
+            emit itemUpdated( QVariantList() << page * PAGE_SIZE + i );
+        }
+    }
+
+
+    void requestPage(int page)
+    {
+        if(pending_pages.contains(page))
+            return;
+
+        QStringList files;
+        for(int i = page * PAGE_SIZE; i < qMin(items.size(), (page + 1) * PAGE_SIZE); i++)
+            files << items[i].value("file").toString();
+
+        pending_pages.insert(page);
+
+        auto *watcher = new QFutureWatcher<QVariantList>(this);
+        watcher->setProperty("page", page);
+        watcher->connect( watcher, SIGNAL(finished()), this, SLOT(onPageRead()) );
+        watcher->setFuture( QtConcurrent::run(&StateListModel::readHeaders, files) );
+    }
+
+
+public:
+    /*
+     *      The states of a library entry, the resume state first
+     *      and then the newest saved state.
+     * */
+    StateListModel(const QVariantMap &game, QObject *parent = nullptr): DataModel(parent)
+    {
+        if(game.contains("resume"))
+        {
+            QVariantMap item;
+            item["file"] = game.value("resume");
+            item["resume"] = true;
+            items << item;
+        }
+
+        const auto &states = game.value("states").toList();
+
+        for(int i = states.size() - 1; i >= 0; i--)
+        {
+            QVariantMap item;
+            item["file"] = states[i];
+            items << item;
+        }
+    }
+
+
+    /*
+     *      DataModel
+     * */
+    int childCount(const QVariantList &indexPath) override
+    {
+        return indexPath.isEmpty() ? items.size() : 0;
+    }
+
+
+    bool hasChildren(const QVariantList &indexPath) override
+    {
+        return indexPath.isEmpty();
+    }
+
+
+    QVariant data(const QVariantList &indexPath) override
+    {
+        if(indexPath.size() != 1)
+            return QVariant();
+
+        const int i = indexPath[0].toInt();
+
+        if(i < 0 || i >= items.size())
+            return QVariant();
+
+        if(!items[i].contains("loaded"))
+            requestPage(i / PAGE_SIZE);
+
+        return items[i];
+    }
+};
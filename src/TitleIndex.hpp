@@ -0,0 +1,239 @@
+/*
+ * TitleIndex.hpp
+ *
+ *  Created on: Oct 19, 2026
+ *      Author: swatson
+ */
+
+#pragma once
+
+#include <vector>
+#include <algorithm>
+
+
+#include <QHash>
+#include <QString>
+#include <QStringList>
+
+
+/*
+ * An in memory trigram index over game titles.
+ *
+ * Every name of a game (its title and any alternate names from
+ * the catalog) is split into words padded like "  word " and cut
+ * into trigrams. A query is scored against each name by the share
+ * of its trigrams the name contains, so a typo only costs the few
+ * trigrams it touches. The last word of a query is treated as a
+ * prefix since it is usually still being typed.
+ * */
+class TitleIndex
+{
+    struct Name
+    {
+        QString game;
+        QString text;
+        int trigrams;
+    };
+
+    std::vector<Name> names;
+    std::vector<int> free_names;
+    QHash<quint64, std::vector<int>> postings;
+    QHash<QString, std::vector<int>> games;
+    QHash<QString, QStringList> alternates;
+
+    std::vector<int> counts;
+
+
+    static QString normalize(const QString &text)
+    {
+        QString out;
+        out.reserve(text.size());
+
+        for(const QChar c : text.toLower())
+        {
+            if(c.isLetterOrNumber())
+                out += c;
+            else if(!out.isEmpty() && !out.endsWith(' '))
+                out += ' ';
+        }
+
+        return out.trimmed();
+    }
+
+
+    static std::vector<quint64> trigrams(const QString &text, bool prefix = false)
+    {
+        std::vector<quint64> result;
+        const QStringList &words = normalize(text).split(' ', QString::SkipEmptyParts);
+
+        for(int w = 0; w < words.size(); w++)
+        {
+            const QString padded = "  " + words[w] + ((prefix && w == words.size() - 1) ? "" : " ");
+
+            for(int i = 0; i + 2 < padded.size(); i++)
+                result.push_back( (quint64)padded[i].unicode() << 32 | (quint64)padded[i + 1].unicode() << 16 | padded[i + 2].unicode() );
+        }
+
+        std::sort(result.begin(), result.end());
+        result.erase(std::unique(result.begin(), result.end()), result.end());
+        return result;
+    }
+
+
+    void addName(const QString &game, const QString &text)
+    {
+        const auto &grams = trigrams(text);
+
+        if(grams.empty())
+            return;
+
+        int id;
+        if(free_names.empty())
+        {
+            id = names.size();
+            names.push_back(Name());
+            counts.push_back(0);
+        }
+        else
+        {
+            id = free_names.back();
+            free_names.pop_back();
+        }
+
+        names[id].game = game;
+        names[id].text = normalize(text);
+        names[id].trigrams = grams.size();
+
+        for(const auto gram : grams)
+            postings[gram].push_back(id);
+
+        games[game].push_back(id);
+    }
+
+
+public:
+    /*
+     *      Alternate names per gameID, e.g. every release title
+     *      the catalog lists for a ROM's CRC.
+     * */
+    void setAlternates(const QHash<QString, QStringList> &alternates)
+    {
+        this->alternates = alternates;
+    }
+
+
+    //
+    //
+    void update(const QString &game, const QString &title)
+    {
+        remove(game);
+
+        QStringList all = alternates.value(game);
+        all.prepend(title);
+        all.removeDuplicates();
+
+        for(const auto &name : all)
+            addName(game, name);
+    }
+
+
+    //
+    //
+    void remove(const QString &game)
+    {
+        const auto found = games.find(game);
+
+        if(found == games.end())
+            return;
+
+        for(const int id : found.value())
+        {
+            for(const auto gram : trigrams(names[id].text))
+            {
+                auto &posting = postings[gram];
+                posting.erase(std::remove(posting.begin(), posting.end(), id), posting.end());
+
+                if(posting.empty())
+                    postings.remove(gram);
+            }
+
+            names[id] = Name();
+            free_names.push_back(id);
+        }
+
+        games.erase(found);
+    }
+
+
+    void clear()
+    {
+        names.clear();
+        free_names.clear();
+        postings.clear();
+        games.clear();
+        counts.clear();
+    }
+
+
+    /*
+     *      Returns gameIDs best match first.
+     * */
+    QStringList query(const QString &text, int limit = 100)
+    {
+        const auto &grams = trigrams(text, true);
+        const QString &needle = normalize(text);
+        std::vector<int> touched;
+
+        if(grams.empty())
+            return QStringList();
+
+        for(const auto gram : grams)
+        {
+            const auto found = postings.constFind(gram);
+
+            if(found == postings.constEnd())
+                continue;
+
+            for(const int id : found.value())
+                if(counts[id]++ == 0)
+                    touched.push_back(id);
+        }
+
+        QHash<QString, double> best;
+
+        for(const int id : touched)
+        {
+            const Name &name = names[id];
+            const double coverage = double(counts[id]) / grams.size();
+            counts[id] = 0;
+
+            // Allow roughly one typo in every few letters.
+            if(coverage < 0.5)
+                continue;
+
+            double score = coverage - name.trigrams * 0.001;
+
+            if(name.text.startsWith(needle))
+                score += 1.5;
+            else if(name.text.contains(needle))
+                score += 1.0;
+
+            if(score > best.value(name.game, -1.0))
+                best[name.game] = score;
+        }
+
+        std::vector<std::pair<double, QString>> ranked;
+        ranked.reserve(best.size());
+
+        for(auto it = best.constBegin(); it != best.constEnd(); ++it)
+            ranked.push_back( std::make_pair(-it.value(), it.key()) );
+
+        std::sort(ranked.begin(), ranked.end());
+
+        QStringList result;
+        for(int i = 0; i < (int)ranked.size() && i < limit; i++)
+            result << ranked[i].second;
+
+        return result;
+    }
+};
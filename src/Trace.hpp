@@ -0,0 +1,245 @@
+/*
+ * Trace.hpp
+ *
+ *  Created on: Oct 19, 2026
+ *      Author: swatson
+ */
+
+#pragma once
+
+#include <cstdio>
+
+
+#include <QHash>
+#include <QFile>
+#include <QList>
+#include <QMutex>
+#include <QThread>
+#include <QByteArray>
+#include <QAtomicInt>
+#include <QElapsedTimer>
+#include <QThreadStorage>
+
+
+/*
+ * Hot path tracing, built in with CONFIG+=trace (MARKV_TRACE).
+ *
+ *     TRACE_SPAN("name");           times the rest of the scope.
+ *     TRACE_COMPLETE("name", ns);   records something that just took ns.
+ *
+ * Names must be string literals; only the pointer is kept. Without
+ * MARKV_TRACE both macros compile to nothing.
+ *
+ * Every thread records into its own ring of the last CAPACITY events
+ * so recording never takes a lock. A ring is handed on to the next
+ * new thread when its owner exits, which keeps the memory bounded
+ * while import workers come and go.
+ *
+ * dump() writes every ring as Chrome trace event JSON, which opens in
+ * chrome://tracing or https://ui.perfetto.dev. Events being written
+ * during a dump may come out garbled; the ring is read oldest last
+ * to make that unlikely.
+ * */
+class Trace
+{
+    static constexpr auto CAPACITY = 8192;
+
+    struct Event
+    {
+        const char *name;
+        qint64 begin;
+        qint64 duration;
+        int tid;
+    };
+
+    struct Ring
+    {
+        Event events[CAPACITY];
+        QAtomicInt count;
+        int tid;
+        bool free;
+    };
+
+    /* Owned by a thread; gives its ring back when the thread exits. */
+    struct Handle
+    {
+        Ring *ring;
+
+        ~Handle()
+        {
+            QMutexLocker lk(&mutex());
+            ring->free = true;
+        }
+    };
+
+
+    static QMutex &mutex()
+    {
+        static QMutex mutex;
+        return mutex;
+    }
+
+    static QList<Ring*> &rings()
+    {
+        static QList<Ring*> rings;
+        return rings;
+    }
+
+    static QHash<int, QByteArray> &threadNames()
+    {
+        static QHash<int, QByteArray> names;
+        return names;
+    }
+
+
+    static Ring *ring()
+    {
+        static QThreadStorage<Handle*> local;
+
+        if(local.hasLocalData())
+            return local.localData()->ring;
+
+        QMutexLocker lk(&mutex());
+        static int next_tid = 1;
+
+        Ring *ring = nullptr;
+        for(auto *candidate : rings())
+        {
+            if(candidate->free)
+            {
+                ring = candidate;
+                break;
+            }
+        }
+
+        if(!ring)
+        {
+            ring = new Ring();
+            rings() << ring;
+        }
+
+        QThread *thread = QThread::currentThread();
+        const QByteArray &name = thread->objectName().isEmpty() ? QByteArray(thread->metaObject()->className()) : thread->objectName().toUtf8();
+
+        ring->tid = next_tid++;
+        ring->free = false;
+        threadNames().insert(ring->tid, name);
+
+        Handle *handle = new Handle;
+        handle->ring = ring;
+        local.setLocalData(handle);
+
+        return ring;
+    }
+
+
+public:
+    /* Nanoseconds since the first event. */
+    static qint64 now()
+    {
+        static QElapsedTimer epoch;
+
+        if(!epoch.isValid())
+            epoch.start();
+
+        return epoch.nsecsElapsed();
+    }
+
+
+    //
+    //
+    static void complete(const char *name, qint64 begin, qint64 duration)
+    {
+        Ring *ring = Trace::ring();
+        const int n = ring->count;
+
+        Event &event = ring->events[n % CAPACITY];
+        event.name = name;
+        event.begin = begin;
+        event.duration = duration;
+        event.tid = ring->tid;
+
+        ring->count.fetchAndStoreRelease(n + 1);
+    }
+
+
+    static void complete(const char *name, qint64 duration)
+    {
+        const qint64 end = now();
+        complete(name, end - duration, duration);
+    }
+
+
+    class Span
+    {
+        const char *name;
+        qint64 begin;
+
+    public:
+        explicit Span(const char *name): name(name), begin(now()) {}
+        ~Span() { complete(name, begin, now() - begin); }
+    };
+
+
+    /*
+     *      Write everything recorded so far as Chrome trace JSON.
+     * */
+    static bool dump(const QString &file)
+    {
+        QFile out(file);
+
+        if(!out.open(QIODevice::WriteOnly | QIODevice::Truncate))
+            return false;
+
+        QList<Ring*> snapshot;
+        QHash<int, QByteArray> names;
+        {
+            QMutexLocker lk(&mutex());
+            snapshot = rings();
+            names = threadNames();
+        }
+
+        out.write("{\"traceEvents\":[\n");
+        bool first = true;
+        char line[256];
+
+        for(auto it = names.constBegin(); it != names.constEnd(); ++it)
+        {
+            snprintf(line, sizeof(line), "%s{\"name\":\"thread_name\",\"ph\":\"M\",\"pid\":1,\"tid\":%d,\"args\":{\"name\":\"%s\"}}",
+                     first ? "" : ",\n", it.key(), it.value().constData());
+            out.write(line);
+            first = false;
+        }
+
+        for(auto *ring : snapshot)
+        {
+            const int count = ring->count.fetchAndAddAcquire(0);
+
+            // Newest first, the oldest slots are the ones being overwritten.
+            for(int i = count - 1; i >= qMax(0, count - CAPACITY); i--)
+            {
+                const Event &event = ring->events[i % CAPACITY];
+
+                snprintf(line, sizeof(line), "%s{\"name\":\"%s\",\"ph\":\"X\",\"pid\":1,\"tid\":%d,\"ts\":%.3f,\"dur\":%.3f}",
+                         first ? "" : ",\n", event.name, event.tid, event.begin / 1000.0, event.duration / 1000.0);
+                out.write(line);
+                first = false;
+            }
+        }
+
+        out.write("\n]}\n");
+
+        return out.error() == QFile::NoError;
+    }
+};
+
+
+#ifdef MARKV_TRACE
+#define TRACE_JOIN_(a, b) a##b
+#define TRACE_JOIN(a, b) TRACE_JOIN_(a, b)
+#define TRACE_SPAN(name) Trace::Span TRACE_JOIN(trace_span_, __LINE__)(name)
+#define TRACE_COMPLETE(name, ns) Trace::complete(name, ns)
+#else
+#define TRACE_SPAN(name) do {} while(0)
+#define TRACE_COMPLETE(name, ns) do {} while(0)
+#endif
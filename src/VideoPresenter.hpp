@@ -0,0 +1,447 @@
+/*
+ * VideoPresenter.hpp
+ *
+ *  Created on: Oct 19, 2026
+ *      Author: swatson
+ */
+
+#pragma once
+
+#include <cstdio>
+#include <vector>
+#include <cstring>
+#include <cstdint>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+
+#if defined(__QNX__)
+#include <screen/screen.h>
+#endif
+
+
+#include <QString>
+#include <QSettings>
+#include <QByteArray>
+#include <QElapsedTimer>
+
+
+/*
+ * Where the emulator's RGB565 frames are shown.
+ *
+ * A presenter owns the buffer the core draws into (buffer()) and
+ * shows it with post(), which returns once the frame has been
+ * taken, normally on the next vsync. Every post is timed so the
+ * interval between frames and the cost of posting can be looked
+ * at without a device.
+ *
+ * Presenters are chosen and configured from QSettings:
+ *
+ *     video/presenter  "screen" (QNX) or "offscreen"
+ *     video/shm        shared memory name for the offscreen frames
+ *     video/refresh    vsync rate the offscreen presenter paces to,
+ *                      0 to post as fast as possible
+ *
+ * open() and attach()/detach() are called from the UI thread,
+ * post() from the video thread.
+ * */
+class VideoPresenter
+{
+public:
+    struct Buffer
+    {
+        uint8_t *data;
+        int pitch;
+    };
+
+
+    struct Timing
+    {
+        qint64 frames;
+        qint64 interval;       // mean time between posts (us)
+        qint64 worst_interval; // longest time between posts (us)
+        qint64 cost;           // mean time spent in a post (us)
+    };
+
+
+    virtual ~VideoPresenter() {}
+
+    virtual bool open(const QByteArray &id, int width, int height) = 0;
+    virtual Buffer buffer() = 0;
+
+    /* Show the window inside a Cascades window group. */
+    virtual void attach(const QByteArray &group) { Q_UNUSED(group); }
+    virtual void detach() {}
+
+
+    //
+    //
+    void post()
+    {
+        const qint64 start = clock.isValid() ? clock.nsecsElapsed() : 0;
+
+        if(!clock.isValid())
+            clock.start();
+
+        swap();
+
+        const qint64 end = clock.nsecsElapsed();
+
+        if(last_post >= 0)
+        {
+            const qint64 interval = (end - last_post) / 1000;
+
+            interval_sum += interval;
+            worst_interval = qMax(worst_interval, interval);
+        }
+
+        cost_sum += (end - start) / 1000;
+        last_post = end;
+        frames++;
+    }
+
+
+    /*
+     *      Since the last reset.
+     * */
+    Timing timing() const
+    {
+        Timing timing;
+        timing.frames = frames;
+        timing.interval = frames > 1 ? interval_sum / (frames - 1) : 0;
+        timing.worst_interval = worst_interval;
+        timing.cost = frames ? cost_sum / frames : 0;
+
+        return timing;
+    }
+
+
+    void resetTiming()
+    {
+        clock.invalidate();
+        last_post = -1;
+        frames = interval_sum = worst_interval = cost_sum = 0;
+    }
+
+
+    /*
+     *      The presenter from the settings.
+     * */
+    static VideoPresenter *create();
+
+
+protected:
+    /* Show the buffer, blocking until it may be drawn into again. */
+    virtual void swap() = 0;
+
+
+private:
+    QElapsedTimer clock;
+    qint64 last_post = -1;
+    qint64 frames = 0;
+    qint64 interval_sum = 0;
+    qint64 worst_interval = 0;
+    qint64 cost_sum = 0;
+};
+
+
+
+/*
+ * Frames go to memory, shared with other processes when a name
+ * is given (e.g. "/markv", POSIX shared memory as on QNX, where it
+ * shows up under /dev/shmem). The shared block is a Header followed by the pixels;
+ * a viewer can map it and show a new frame whenever the frame
+ * count changes.
+ * */
+class OffscreenPresenter: public VideoPresenter
+{
+public:
+    struct Header
+    {
+        char magic[4];
+        uint32_t width;
+        uint32_t height;
+        uint32_t pitch;
+        volatile uint32_t frame;
+    };
+
+
+private:
+    QByteArray shm_name;
+    int refresh;
+
+    std::vector<uint8_t> memory;
+    Header *shared = nullptr;
+    size_t shared_size = 0;
+
+    Header *header = nullptr;
+    uint8_t *pixels = nullptr;
+    int pitch = 0;
+
+    QElapsedTimer vsync;
+    qint64 ticks = 0;
+
+
+public:
+    OffscreenPresenter(const QString &shm_name = QString(), int refresh = 60):
+        shm_name(shm_name.toAscii()), refresh(refresh)
+    {
+    }
+
+    ~OffscreenPresenter()
+    {
+        if(shared)
+        {
+            munmap(shared, shared_size);
+            shm_unlink(shm_name.constData());
+        }
+    }
+
+    bool open(const QByteArray &id, int width, int height) override
+    {
+        Q_UNUSED(id);
+
+        pitch = width * sizeof(uint16_t);
+        const size_t size = sizeof(Header) + (size_t)pitch * height;
+
+        if(!shm_name.isEmpty())
+        {
+            const int fd = shm_open(shm_name.constData(), O_RDWR | O_CREAT, 0644);
+
+            if(fd >= 0 && ftruncate(fd, size) == 0)
+            {
+                void *block = mmap(nullptr, size, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+
+                if(block != MAP_FAILED)
+                {
+                    shared = (Header *)block;
+                    shared_size = size;
+                }
+            }
+            else
+                perror("shm_open");
+
+            if(fd >= 0)
+                close(fd);
+        }
+
+        if(!shared)
+            memory.assign(size, 0);
+
+        header = shared ? shared : (Header *)memory.data();
+        pixels = (uint8_t *)(header + 1);
+
+        memcpy(header->magic, "MKVF", 4);
+        header->width = width;
+        header->height = height;
+        header->pitch = pitch;
+        header->frame = 0;
+
+        return true;
+    }
+
+    Buffer buffer() override
+    {
+        Buffer buffer = { pixels, pitch };
+        return buffer;
+    }
+
+
+protected:
+    void swap() override
+    {
+        __sync_synchronize();
+        header->frame++;
+
+        if(refresh <= 0)
+            return;
+
+        // Wait for the next tick of a fake display running at refresh Hz.
+        if(!vsync.isValid())
+            vsync.start();
+
+        const qint64 next = ++ticks * 1000000 / refresh;
+        const qint64 now = vsync.nsecsElapsed() / 1000;
+
+        if(next > now)
+            usleep(next - now);
+        else
+            ticks = now * refresh / 1000000;
+    }
+};
+
+
+
+#if defined(__QNX__)
+/*
+ * A QNX Screen child window, shown by a ForeignWindowControl.
+ *
+ * http://www.qnx.com/developers/docs/660/index.jsp?topic=%2Fcom.qnx.doc.screen%2Ftopic%2Fmanual%2Fcscreen_about.html
+ * */
+class ScreenPresenter: public VideoPresenter
+{
+    screen_context_t screen_ctx = nullptr;
+    screen_window_t  screen_win = nullptr;
+    screen_buffer_t  screen_buf = nullptr;
+
+    int rect[4] = { 0, 0, 0, 0 };
+
+
+public:
+    ~ScreenPresenter()
+    {
+        if(screen_ctx)
+        {
+            /* Free Screen API resources */
+            screen_destroy_buffer(screen_buf);
+            screen_destroy_window(screen_win);
+            screen_destroy_context(screen_ctx);
+        }
+    }
+
+    bool open(const QByteArray &id, int width, int height) override
+    {
+        rect[2] = width;
+        rect[3] = height;
+
+        /* Create Screen Context */
+        if( screen_create_context(&screen_ctx, SCREEN_APPLICATION_CONTEXT) ) {
+            perror("screen_create_context");
+            return false;
+        }
+
+        /* Create Screen Window */
+        if( screen_create_window_type(&screen_win, screen_ctx, SCREEN_CHILD_WINDOW) ) {
+            perror("screen_create_window_type");
+        }
+
+        /* Create Screen Buffer */
+        if( screen_create_window_buffers(screen_win, 1) ) {
+            perror("screen_create_window_buffers");
+        }
+
+        if( screen_set_window_property_cv(screen_win, SCREEN_PROPERTY_ID_STRING, id.length(), id.constData()) ) {
+            perror("screen_set_window_property_cv");
+        }
+
+#ifdef QT_DEBUG
+        int debug = SCREEN_DEBUG_STATISTICS;
+        if( screen_set_window_property_iv(screen_win, SCREEN_PROPERTY_DEBUG, &debug) ) {
+            perror("screen_set_window_property_iv(SCREEN_PROPERTY_DEBUG)");
+        }
+#endif
+
+        int z = -5;
+        if( screen_set_window_property_iv(screen_win, SCREEN_PROPERTY_ZORDER, &z) ) {
+            perror("screen_set_window_property_iv(SCREEN_PROPERTY_ZORDER)");
+        }
+
+        int interval = 1;
+        if( screen_set_window_property_iv(screen_win, SCREEN_PROPERTY_SWAP_INTERVAL, &interval) ) {
+            perror("screen_set_window_property_iv(SCREEN_PROPERTY_SWAP_INTERVAL)");
+        }
+
+        int idle_mode = SCREEN_IDLE_MODE_KEEP_AWAKE;
+        if( screen_set_window_property_iv(screen_win, SCREEN_PROPERTY_IDLE_MODE, &idle_mode) ) {
+            perror("screen_set_window_property_iv(SCREEN_PROPERTY_IDLE_MODE)");
+        }
+
+        int usage = SCREEN_USAGE_WRITE;
+        if( screen_set_window_property_iv(screen_win, SCREEN_PROPERTY_USAGE, &usage) ) {
+            perror("screen_set_window_property_iv(SCREEN_PROPERTY_USAGE)");
+        }
+
+        int format = SCREEN_FORMAT_RGB565;
+        if( screen_set_window_property_iv(screen_win, SCREEN_PROPERTY_FORMAT, &format) ) {
+            perror("screen_set_window_property_iv(SCREEN_PROPERTY_FORMAT)");
+        }
+
+        int scale = 16;
+        if( screen_set_window_property_iv(screen_win, SCREEN_PROPERTY_SCALE_FACTOR, &scale) ) {
+            perror("screen_set_window_property_iv(SCREEN_PROPERTY_SCALE_FACTOR)");
+        }
+
+        int scale_quality = SCREEN_QUALITY_FASTEST;
+        if( screen_set_window_property_iv(screen_win, SCREEN_PROPERTY_SCALE_QUALITY, &scale_quality) ) {
+            perror("screen_set_window_property_iv(SCREEN_PROPERTY_SCALE_QUALITY)");
+        }
+
+        int dims[2] = { width, height };
+        if( screen_set_window_property_iv(screen_win, SCREEN_PROPERTY_SOURCE_SIZE, dims) ) {
+            perror("screen_set_window_property_iv(SCREEN_PROPERTY_SOURCE_SIZE)");
+        }
+
+        if( screen_set_window_property_iv(screen_win, SCREEN_PROPERTY_BUFFER_SIZE, dims) ) {
+            perror("screen_set_window_property_iv(SCREEN_PROPERTY_BUFFER_SIZE)");
+        }
+
+        /* Get Screen Buffer Attributes */
+        if( screen_get_window_property_pv(screen_win, SCREEN_PROPERTY_RENDER_BUFFERS, (void **)&screen_buf) ) {
+            perror("screen_get_window_property_pv(SCREEN_PROPERTY_RENDER_BUFFERS)");
+            return false;
+        }
+
+        return true;
+    }
+
+    Buffer buffer() override
+    {
+        Buffer buffer = { nullptr, 0 };
+
+        if( screen_get_buffer_property_iv(screen_buf, SCREEN_PROPERTY_STRIDE, &buffer.pitch) ) {
+            perror("screen_get_buffer_property_iv(SCREEN_PROPERTY_STRIDE)");
+        }
+
+        if( screen_get_buffer_property_pv(screen_buf, SCREEN_PROPERTY_POINTER, (void **)&buffer.data) ) {
+            perror("screen_get_buffer_property_pv(SCREEN_PROPERTY_POINTER)");
+        }
+
+        return buffer;
+    }
+
+    void attach(const QByteArray &group) override
+    {
+        /* Attach Window to ForignWindowView */
+        if( screen_join_window_group(screen_win, group.constData()) ) {
+            perror("screen_join_window_group");
+        }
+    }
+
+    void detach() override
+    {
+        if( screen_leave_window_group(screen_win) ) {
+            perror("screen_leave_window_group");
+        }
+    }
+
+
+protected:
+    void swap() override
+    {
+        screen_post_window(screen_win, screen_buf, 1, rect, SCREEN_WAIT_IDLE);
+    }
+};
+#endif
+
+
+
+inline VideoPresenter *VideoPresenter::create()
+{
+    QSettings settings;
+
+#if defined(__QNX__)
+    const QString &name = settings.value("video/presenter", "screen").toString();
+#else
+    const QString &name = settings.value("video/presenter", "offscreen").toString();
+#endif
+
+#if defined(__QNX__)
+    if(name == "screen")
+        return new ScreenPresenter();
+#endif
+
+    if(name != "offscreen")
+        fprintf( stderr, "VideoPresenter: no %s presenter, using offscreen\n", name.toAscii().constData() );
+
+    return new OffscreenPresenter( settings.value("video/shm").toString(), settings.value("video/refresh", 60).toInt() );
+}
@@ -0,0 +1,205 @@
+/*
+ * ZipReader.hpp
+ *
+ *  Created on: Oct 19, 2026
+ *      Author: swatson
+ */
+
+#pragma once
+
+#include <zlib.h>
+
+#include <cstring>
+#include <functional>
+
+
+#include <QFile>
+#include <QList>
+#include <QString>
+#include <QByteArray>
+
+
+/*
+ * Just enough of the zip format to list an archive from its
+ * central directory and stream a member's contents out through
+ * zlib without writing anything to disk. Stored and deflated
+ * members are supported; zip64 and encrypted members are not.
+ * */
+class ZipReader
+{
+    static quint16 u16(const char *p) { return (quint8)p[0] | (quint8)p[1] << 8; }
+    static quint32 u32(const char *p) { return u16(p) | (quint32)u16(p + 2) << 16; }
+
+
+public:
+    struct Member
+    {
+        QString name;
+        quint32 crc;
+        quint16 method;
+        qint64 compressed;
+        qint64 size;
+        qint64 header_offset;
+    };
+
+
+    /*
+     *      Lists the members of an archive. Empty if it isn't one.
+     * */
+    static QList<Member> members(const QString &path)
+    {
+        QList<Member> result;
+        QFile zip(path);
+
+        if(!zip.open(QIODevice::ReadOnly) || zip.size() < 22)
+            return result;
+
+        // The end of central directory record is in the last 64KB + 22 bytes.
+        const qint64 tail_size = qMin<qint64>(zip.size(), 0xffff + 22);
+        zip.seek(zip.size() - tail_size);
+        const QByteArray &tail = zip.read(tail_size);
+
+        int eocd = -1;
+        for(int i = tail.size() - 22; i >= 0; i--)
+        {
+            if(u32(tail.constData() + i) == 0x06054b50)
+            {
+                eocd = i;
+                break;
+            }
+        }
+
+        if(eocd < 0)
+            return result;
+
+        const quint16 count  = u16(tail.constData() + eocd + 10);
+        const quint32 size   = u32(tail.constData() + eocd + 12);
+        const quint32 offset = u32(tail.constData() + eocd + 16);
+
+        if(!zip.seek(offset))
+            return result;
+
+        const QByteArray &directory = zip.read(size);
+        const char *p = directory.constData();
+        const char *end = p + directory.size();
+
+        for(int i = 0; i < count && p + 46 <= end && u32(p) == 0x02014b50; i++)
+        {
+            const quint16 flags       = u16(p + 8);
+            const quint16 name_len    = u16(p + 28);
+            const quint16 extra_len   = u16(p + 30);
+            const quint16 comment_len = u16(p + 32);
+
+            if(p + 46 + name_len > end)
+                break;
+
+            Member member;
+            member.method        = u16(p + 10);
+            member.crc           = u32(p + 16);
+            member.compressed    = u32(p + 20);
+            member.size          = u32(p + 24);
+            member.header_offset = u32(p + 42);
+            member.name          = QString::fromUtf8(p + 46, name_len);
+
+            const bool encrypted = flags & 0x1;
+            const bool zip64 = member.compressed == 0xffffffff || member.size == 0xffffffff || member.header_offset == 0xffffffff;
+            const bool directory_entry = member.name.endsWith('/');
+
+            if(!encrypted && !zip64 && !directory_entry && (member.method == 0 || member.method == 8))
+                result << member;
+
+            p += 46 + name_len + extra_len + comment_len;
+        }
+
+        return result;
+    }
+
+
+    /*
+     *      Streams the uncompressed contents of a member to sink in
+     *      chunks. Stops early if sink returns false. Returns true if
+     *      the whole member was read and its CRC matched.
+     * */
+    static bool extract(const QString &path, const Member &member, const std::function<bool(const char *, int)> &sink)
+    {
+        QFile zip(path);
+
+        if(!zip.open(QIODevice::ReadOnly) || !zip.seek(member.header_offset))
+            return false;
+
+        const QByteArray &header = zip.read(30);
+        if(header.size() != 30 || u32(header.constData()) != 0x04034b50)
+            return false;
+
+        if(!zip.seek(member.header_offset + 30 + u16(header.constData() + 26) + u16(header.constData() + 28)))
+            return false;
+
+        static constexpr auto CHUNK = 64 * 1024;
+        QByteArray out(CHUNK * 4, 0);
+        uLong crc = crc32(0L, Z_NULL, 0);
+        qint64 remaining = member.compressed;
+        qint64 produced = 0;
+
+        z_stream stream;
+        memset(&stream, 0, sizeof(stream));
+
+        if(member.method == 8 && inflateInit2(&stream, -MAX_WBITS) != Z_OK)
+            return false;
+
+        bool ok = true;
+        int status = Z_OK;
+
+        while(ok && remaining > 0 && status != Z_STREAM_END)
+        {
+            const QByteArray &in = zip.read(qMin<qint64>(CHUNK, remaining));
+
+            if(in.isEmpty())
+            {
+                ok = false;
+                break;
+            }
+
+            remaining -= in.size();
+
+            if(member.method == 0)
+            {
+                crc = crc32(crc, (const Bytef *)in.constData(), in.size());
+                produced += in.size();
+                ok = sink(in.constData(), in.size());
+                continue;
+            }
+
+            stream.next_in = (Bytef *)in.constData();
+            stream.avail_in = in.size();
+
+            do
+            {
+                stream.next_out = (Bytef *)out.data();
+                stream.avail_out = out.size();
+
+                status = inflate(&stream, Z_NO_FLUSH);
+                if(status != Z_OK && status != Z_STREAM_END && status != Z_BUF_ERROR)
+                {
+                    ok = false;
+                    break;
+                }
+
+                const int have = out.size() - stream.avail_out;
+                crc = crc32(crc, (const Bytef *)out.constData(), have);
+                produced += have;
+
+                if(have && !sink(out.constData(), have))
+                {
+                    ok = false;
+                    break;
+                }
+            }
+            while(stream.avail_out == 0);
+        }
+
+        if(member.method == 8)
+            inflateEnd(&stream);
+
+        return ok && produced == member.size && crc == member.crc;
+    }
+};
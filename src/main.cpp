@@ -1,4 +1,7 @@
 #include "GameLibraryUI.hpp"
+#include "HeadlessRunner.hpp"
+
+#include <QCoreApplication>
 
 #include <bb/cascades/Application>
 
@@ -7,6 +10,19 @@ using namespace bb::cascades;
 
 Q_DECL_EXPORT int main(int argc, char **argv)
 {
+    /* Headless modes run without any UI. */
+    {
+        QStringList args;
+        for(int i = 0; i < argc; i++)
+            args << argv[i];
+
+        if(HeadlessRunner::handles(args))
+        {
+            QCoreApplication app(argc, argv);
+            return HeadlessRunner().exec(app.arguments());
+        }
+    }
+
     Application app(argc, argv);
     GameLibraryUI game_library_ui;
 